@@ -0,0 +1,118 @@
+#include "async_log.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * ASYNC LOG BENCHMARK
+ * How long a LOG call keeps the calling thread busy, in ns per call:
+ *   sync_log:  the helper every other file defines, (std::cout << ... << args) << std::endl
+ *   LOG:       async_log.h, binary record into the thread's ring buffer
+ * The same line with a few ints, a double, a string and the thread id, 1 to 8 threads logging at
+ * once. stdout goes to /dev/null while measuring (dup2), so both pay for the real std::cout
+ * machinery but not for a terminal.
+ */
+
+template <typename... Args>
+void sync_log(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/// Points stdout (fd 1) to /dev/null while alive.
+class SilenceStdout
+{
+public:
+    SilenceStdout()
+    {
+        async_log::flush(); // LOG lines still queued would end up in /dev/null
+        std::cout.flush();
+        std::fflush(stdout);
+        m_saved = dup(STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+
+    ~SilenceStdout()
+    {
+        async_log::flush();
+        std::cout.flush();
+        std::fflush(stdout);
+        dup2(m_saved, STDOUT_FILENO);
+        close(m_saved);
+    }
+
+private:
+    int m_saved;
+};
+
+/**
+ * Every thread logs `bursts` x `burst_size` lines and sleeps `pause` after every burst, only the time
+ * inside the bursts counts. Returns ns per call, averaged over all threads.
+ * Short bursts with pauses are the usual pattern and measure the hot path: a burst fits into the
+ * ring buffer, and the background thread catches up during the pause. One long burst without pauses
+ * measures sustained throughput instead: LOG then waits for the background thread whenever the ring
+ * is full.
+ */
+template <typename Log>
+double benchmark(size_t num_threads, size_t bursts, size_t burst_size, std::chrono::microseconds pause, Log log)
+{
+    std::vector<double> busy(num_threads);
+    {
+        SilenceStdout silence;
+        std::vector<std::thread> threads;
+        for(size_t t=0; t<num_threads; ++t)
+        {
+            threads.emplace_back([&, t](){
+                for(size_t burst=0; burst<bursts; ++burst)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    for(size_t i=0; i<burst_size; ++i)
+                    {
+                        log("worker ", t, " iteration ", i, " value ", i * 0.25, " status ", "ok", " on ", std::this_thread::get_id());
+                    }
+                    busy[t] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                    std::this_thread::sleep_for(pause);
+                }
+            });
+        }
+        for(auto& thread: threads)
+        {
+            thread.join();
+        }
+    } // ~SilenceStdout flushes
+
+    double busy_ns = 0.0;
+    for(double ns: busy)
+    {
+        busy_ns += ns;
+    }
+    return busy_ns / static_cast<double>(num_threads * bursts * burst_size);
+}
+
+int main(int argc, char** argv)
+{
+    LOG("Hello from ", "async_log.h, thread ", std::this_thread::get_id(), ", pi ~ ", 3.14159, ", answer ", 42);
+    LOG("A std::string ", std::string(3, 'x'), " and a char ", 'c', " and a bool ", true);
+    async_log::flush();
+
+    using namespace std::chrono_literals;
+    auto sync = [](const auto&... args){ sync_log(args...); };
+    auto async = [](const auto&... args){ LOG(args...); };
+    for(size_t num_threads : {1, 2, 4, 8})
+    {
+        LOG(num_threads, " threads, bursts of 1000: sync_log ", benchmark(num_threads, 100, 1000, 2000us, sync),
+            " ns/call | LOG ", benchmark(num_threads, 100, 1000, 2000us, async), " ns/call");
+        LOG(num_threads, " threads, sustained:      sync_log ", benchmark(num_threads, 1, 100000, 0us, sync),
+            " ns/call | LOG ", benchmark(num_threads, 1, 100000, 0us, async), " ns/call");
+    }
+    return 0;
+}
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * ASYNCHRONOUS LOGGING BACKEND FOR LOG()
+ * The LOG helper every file defines copies its arguments and does (std::cout << ... << args) << std::endl:
+ * the caller formats, every line is a flush (a write system call), and all threads queue up on the
+ * stream. Including this header instead of defining LOG gives the same call syntax with this split:
+ *
+ *  - Caller (hot path): no formatting, no lock, no system call. The arguments are copied as compact
+ *    binary into the calling thread's own ring buffer (single producer, single consumer):
+ *        [size | format function | timestamp] [arg 1] [arg 2] ...
+ *    Numbers, chars, bools, enums and std::thread::id are copied as raw bytes, strings as length +
+ *    characters. Anything else is formatted with operator<< on the spot (slow path, but still no
+ *    lock, and manipulators before it in the same call don't apply to it). That includes other
+ *    trivially copyable types: a const unsigned char* or a struct holding a const char* would be
+ *    printed later through a pointer the caller may have changed or freed by then.
+ *    Manipulators are records too: std::left, std::hex, ... are stored as function pointers,
+ *    std::setw, std::setprecision, ... as their values, and both are applied
+ *    when the line is formatted. The format state is reset before every line, so unlike with
+ *    std::cout a manipulator only lasts until the end of its LOG call.
+ *    The format function is format_record<decoded types...>, instantiated per LOG call signature, so
+ *    the record doesn't need to describe its own types.
+ *  - One background thread collects what every thread wrote, orders it by timestamp, formats it and
+ *    writes the whole batch with a single write + flush.
+ *
+ * The hot path only writes to its own buffer and its own head index, so logging threads don't share
+ * any cache line. The price: the background thread can't be notified without one, so when there is
+ * nothing to do it checks again every POLL_INTERVAL. flush() (and the end of the program) writes
+ * everything logged so far right away.
+ *
+ * A full ring buffer blocks its thread until the background thread catches up: no lines get lost.
+ * Lines from different threads are ordered by timestamp within a batch, not across batches.
+ * Not usable from static destructors: the background thread is a static itself.
+ */
+
+namespace async_log
+{
+    using Clock = std::chrono::steady_clock;
+    using FormatFn = void (*)(const std::byte* payload, std::ostream& out);
+
+    constexpr auto POLL_INTERVAL = std::chrono::milliseconds(1);
+
+    struct RecordHeader
+    {
+        std::uint32_t size;  // whole record including the header, multiple of 8
+        FormatFn format;     // nullptr: padding up to the end of the ring
+        Clock::rep timestamp;
+    };
+
+    /// Bytes written by one thread, read by the background thread.
+    class Buffer
+    {
+    public:
+        static constexpr size_t CAPACITY = size_t{1} << 18; // power of 2
+        static constexpr size_t MAX_RECORD = CAPACITY / 4;  // bigger records take the slow path
+
+        Buffer(): m_data(std::make_unique<std::byte[]>(CAPACITY)) {}
+
+        /// Producer: room for `size` contiguous bytes, waits while the buffer is full.
+        std::byte* reserve(size_t size)
+        {
+            std::uint64_t head = m_head.load(std::memory_order_relaxed);
+            size_t offset = head & (CAPACITY - 1);
+            size_t padding = offset + size > CAPACITY ? CAPACITY - offset : 0;
+            while(head + padding + size - m_cached_tail > CAPACITY)
+            {
+                m_cached_tail = m_tail.load(std::memory_order_acquire);
+                if(head + padding + size - m_cached_tail > CAPACITY)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            if(padding)
+            {
+                // A record never wraps around. Less than a header left: the reader skips it anyway.
+                if(padding >= sizeof(RecordHeader))
+                {
+                    RecordHeader pad{static_cast<std::uint32_t>(padding), nullptr, 0};
+                    std::memcpy(m_data.get() + offset, &pad, sizeof(pad));
+                }
+                m_head.store(head + padding, std::memory_order_release);
+                return m_data.get();
+            }
+            return m_data.get() + offset;
+        }
+
+        /// Producer: publishes the bytes returned by reserve().
+        void commit(size_t size)
+        {
+            m_head.store(m_head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        }
+
+        std::uint64_t head() const { return m_head.load(std::memory_order_acquire); }
+        std::uint64_t tail() const { return m_tail.load(std::memory_order_acquire); }
+        const std::byte* at(std::uint64_t position) const { return m_data.get() + (position & (CAPACITY - 1)); }
+
+        /// Consumer: everything before `position` has been written out.
+        void release(std::uint64_t position) { m_tail.store(position, std::memory_order_release); }
+
+        void retire() { m_retired.store(true, std::memory_order_release); }
+        bool retired() const { return m_retired.load(std::memory_order_acquire); }
+
+    private:
+        alignas(64) std::atomic<std::uint64_t> m_head{0};
+        std::uint64_t m_cached_tail{0}; // producer only
+        alignas(64) std::atomic<std::uint64_t> m_tail{0};
+        std::atomic<bool> m_retired{false};
+        std::unique_ptr<std::byte[]> m_data;
+    };
+
+    class Logger
+    {
+    public:
+        static Logger& instance()
+        {
+            static Logger logger;
+            return logger;
+        }
+
+        std::shared_ptr<Buffer> register_thread()
+        {
+            auto buffer = std::make_shared<Buffer>();
+            std::lock_guard lock(m_mutex);
+            m_buffers.push_back(buffer);
+            return buffer;
+        }
+
+        /// Slow path for records that don't fit a ring buffer, the caller formatted the line already.
+        void write_line(Clock::rep timestamp, std::string line)
+        {
+            std::lock_guard lock(m_mutex);
+            m_lines.push_back({timestamp, std::move(line)});
+        }
+
+        /// Returns once everything logged before the call has been written.
+        void flush()
+        {
+            std::unique_lock lock(m_mutex);
+            // shared_ptr: a finished thread's buffer may be dropped from m_buffers while we wait.
+            std::vector<std::pair<std::shared_ptr<Buffer>, std::uint64_t>> targets;
+            for(const auto& buffer: m_buffers)
+            {
+                targets.emplace_back(buffer, buffer->head());
+            }
+            std::uint64_t lines_target = m_lines_pushed + m_lines.size();
+            m_flush_requested = true;
+            m_wakeup.notify_all();
+            m_drained.wait(lock, [&](){
+                return m_lines_written >= lines_target &&
+                       std::all_of(targets.begin(), targets.end(),
+                                   [](const auto& target){ return target.first->tail() >= target.second; });
+            });
+        }
+
+        /// Where the lines go, std::cout by default. Writes out what was logged before first.
+        void set_output(std::ostream& out)
+        {
+            flush();
+            m_out.store(&out, std::memory_order_release);
+        }
+
+    private:
+        struct Line
+        {
+            Clock::rep timestamp;
+            std::string text;
+        };
+
+        struct View
+        {
+            Clock::rep timestamp;
+            FormatFn format;  // nullptr: text
+            const std::byte* payload;
+            const std::string* text;
+        };
+
+        std::mutex m_mutex;
+        std::condition_variable_any m_wakeup;
+        std::condition_variable_any m_drained;
+        bool m_flush_requested{false};
+        std::vector<std::shared_ptr<Buffer>> m_buffers;
+        std::vector<Line> m_lines;
+        std::uint64_t m_lines_pushed{0};  // lines taken out of m_lines by the background thread
+        std::uint64_t m_lines_written{0};
+        std::atomic<std::ostream*> m_out{&std::cout};
+
+        // Background thread only.
+        std::vector<std::shared_ptr<Buffer>> m_drain_buffers;
+        std::vector<std::uint64_t> m_drain_heads;
+        std::vector<Line> m_drain_lines;
+        std::vector<View> m_views;
+        std::ostringstream m_batch;
+        const std::ios_base::fmtflags m_default_flags{m_batch.flags()};
+        const std::streamsize m_default_precision{m_batch.precision()};
+        const char m_default_fill{m_batch.fill()};
+
+        /// NOTE: Last member: the final drain in its destructor uses everything above.
+        std::jthread m_thread{[this](std::stop_token stoken){ run(stoken); }};
+
+        Logger() = default;
+
+        void run(std::stop_token stoken)
+        {
+            while(true)
+            {
+                bool stopping = stoken.stop_requested(); // one more full drain after the stop request
+                drain();
+                if(stopping)
+                {
+                    return;
+                }
+                std::unique_lock lock(m_mutex);
+                m_drained.notify_all();
+                m_wakeup.wait_for(lock, stoken, POLL_INTERVAL, [this](){ return m_flush_requested; });
+                m_flush_requested = false;
+            }
+        }
+
+        void drain()
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                // A finished thread's buffer goes once everything in it is written.
+                std::erase_if(m_buffers, [](const auto& buffer){
+                    return buffer->retired() && buffer->tail() == buffer->head();
+                });
+                m_drain_buffers = m_buffers;
+                m_drain_lines.swap(m_lines);
+                m_lines_pushed += m_drain_lines.size();
+            }
+
+            m_views.clear();
+            m_drain_heads.clear();
+            for(const auto& buffer: m_drain_buffers)
+            {
+                std::uint64_t head = buffer->head();
+                std::uint64_t position = buffer->tail();
+                while(position < head)
+                {
+                    size_t left_to_end = Buffer::CAPACITY - (position & (Buffer::CAPACITY - 1));
+                    if(left_to_end < sizeof(RecordHeader))
+                    {
+                        position += left_to_end;
+                        continue;
+                    }
+                    RecordHeader record;
+                    std::memcpy(&record, buffer->at(position), sizeof(record));
+                    if(record.format)
+                    {
+                        m_views.push_back({record.timestamp, record.format, buffer->at(position) + sizeof(record), nullptr});
+                    }
+                    position += record.size;
+                }
+                m_drain_heads.push_back(head);
+            }
+            for(const Line& line: m_drain_lines)
+            {
+                m_views.push_back({line.timestamp, nullptr, nullptr, &line.text});
+            }
+            if(m_views.empty())
+            {
+                return;
+            }
+
+            // Each buffer is in order already, this interleaves the threads.
+            std::stable_sort(m_views.begin(), m_views.end(),
+                             [](const View& a, const View& b){ return a.timestamp < b.timestamp; });
+            m_batch.str({});
+            for(const View& view: m_views)
+            {
+                // Manipulators of the previous line (maybe another thread's) must not leak into this one.
+                m_batch.flags(m_default_flags);
+                m_batch.precision(m_default_precision);
+                m_batch.fill(m_default_fill);
+                m_batch.width(0);
+                if(view.format)
+                {
+                    view.format(view.payload, m_batch);
+                }
+                else
+                {
+                    m_batch << *view.text;
+                }
+                m_batch.width(0);
+                m_batch << '\n';
+            }
+            std::ostream& out = *m_out.load(std::memory_order_acquire);
+            std::string_view batch = m_batch.view();
+            out.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+            out.flush();
+
+            // Only now: the records (and string views into them) were in use until here.
+            for(size_t i=0; i<m_drain_buffers.size(); ++i)
+            {
+                m_drain_buffers[i]->release(m_drain_heads[i]);
+            }
+            std::lock_guard lock(m_mutex);
+            m_lines_written += m_drain_lines.size();
+            m_drain_lines.clear();
+        }
+    };
+
+    namespace detail
+    {
+        /// Owns the calling thread's buffer, marks it finished when the thread exits.
+        struct ThreadBuffer
+        {
+            std::shared_ptr<Buffer> buffer = Logger::instance().register_thread();
+            ~ThreadBuffer() { buffer->retire(); }
+        };
+
+        inline Buffer& local_buffer()
+        {
+            thread_local ThreadBuffer local;
+            return *local.buffer;
+        }
+
+        /// Types whose operator<< only looks at the bytes of the value, never through a pointer, so
+        /// they can be copied now and formatted later.
+        template <typename T>
+        constexpr bool is_plain_value = std::is_arithmetic_v<T> || std::is_enum_v<T> ||
+                                        std::is_same_v<T, std::thread::id> ||
+                                        std::is_same_v<T, decltype(std::setw(0))> ||
+                                        std::is_same_v<T, decltype(std::setprecision(0))> ||
+                                        std::is_same_v<T, decltype(std::setfill(' '))> ||
+                                        std::is_same_v<T, decltype(std::setbase(0))> ||
+                                        std::is_same_v<T, decltype(std::setiosflags(std::ios_base::fmtflags{}))> ||
+                                        std::is_same_v<T, decltype(std::resetiosflags(std::ios_base::fmtflags{}))>;
+
+        /// What gets stored for an argument: a string view, a raw copy, or the formatted text.
+        template <typename T>
+        auto prepare(const T& arg)
+        {
+            if constexpr(std::is_convertible_v<const T&, std::string_view>)
+            {
+                return std::string_view(arg);
+            }
+            else if constexpr(std::is_function_v<T>)
+            {
+                return &arg; // std::left, std::boolalpha, std::hex, ...
+            }
+            else if constexpr(is_plain_value<T>)
+            {
+                static_assert(std::is_trivially_copyable_v<T>);
+                return arg;
+            }
+            else
+            {
+                std::ostringstream text;
+                text << arg;
+                return std::move(text).str();
+            }
+        }
+
+        /// Type the format function reads back.
+        template <typename Prepared>
+        using Decoded = std::conditional_t<std::is_same_v<Prepared, std::string>, std::string_view, Prepared>;
+
+        template <typename Prepared>
+        size_t encoded_size(const Prepared& value)
+        {
+            if constexpr(std::is_same_v<Decoded<Prepared>, std::string_view>)
+            {
+                return sizeof(std::uint32_t) + value.size();
+            }
+            else
+            {
+                return sizeof(Prepared);
+            }
+        }
+
+        template <typename Prepared>
+        void encode(std::byte*& out, const Prepared& value)
+        {
+            if constexpr(std::is_same_v<Decoded<Prepared>, std::string_view>)
+            {
+                auto length = static_cast<std::uint32_t>(value.size());
+                std::memcpy(out, &length, sizeof(length));
+                std::memcpy(out + sizeof(length), value.data(), length);
+                out += sizeof(length) + length;
+            }
+            else
+            {
+                std::memcpy(out, &value, sizeof(value));
+                out += sizeof(value);
+            }
+        }
+
+        template <typename T>
+        T decode(const std::byte*& in)
+        {
+            if constexpr(std::is_same_v<T, std::string_view>)
+            {
+                std::uint32_t length;
+                std::memcpy(&length, in, sizeof(length));
+                std::string_view text(reinterpret_cast<const char*>(in + sizeof(length)), length);
+                in += sizeof(length) + length;
+                return text;
+            }
+            else
+            {
+                // bit_cast: T needn't be default constructible.
+                std::array<std::byte, sizeof(T)> raw;
+                std::memcpy(raw.data(), in, sizeof(T));
+                in += sizeof(T);
+                return std::bit_cast<T>(raw);
+            }
+        }
+
+        template <typename... Types>
+        void format_record(const std::byte* payload, std::ostream& out)
+        {
+            ((out << decode<Types>(payload)), ...); // comma fold: left to right, same order as encode
+        }
+
+        template <typename... Prepared>
+        void write(const Prepared&... values)
+        {
+            Clock::rep timestamp = Clock::now().time_since_epoch().count();
+            size_t size = sizeof(RecordHeader) + (size_t{0} + ... + encoded_size(values));
+            size = (size + 7) & ~size_t{7};
+            if(size > Buffer::MAX_RECORD)
+            {
+                std::ostringstream line;
+                (line << ... << values);
+                Logger::instance().write_line(timestamp, std::move(line).str());
+                return;
+            }
+
+            Buffer& buffer = local_buffer();
+            std::byte* out = buffer.reserve(size);
+            RecordHeader header{static_cast<std::uint32_t>(size), &format_record<Decoded<Prepared>...>, timestamp};
+            std::memcpy(out, &header, sizeof(header));
+            out += sizeof(header);
+            (encode(out, values), ...);
+            buffer.commit(size);
+        }
+    }
+
+    template <typename... Args>
+    void log(const Args&... args)
+    {
+        detail::write(detail::prepare(args)...);
+    }
+
+    inline void flush()
+    {
+        Logger::instance().flush();
+    }
+}
+
+/// Drop-in for the per-file LOG helper.
+template <typename... Args>
+void LOG(const Args&... args)
+{
+    async_log::log(args...);
+}
@@ -3,6 +3,13 @@
 #include <mutex>
 #include <semaphore>
 #include <optional>
+#include <array>
+#include <span>
+#include <new>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
 
 template <typename... Args>
 void LOG(Args... args)
@@ -78,6 +85,379 @@ private:
     }
 };
 
+/**
+ * SlotBoundedBuffer: the same ring and semaphores as BoundedBuffer, but the slots are raw storage.
+ * Elements are constructed in their slot and destroyed when they leave it, so pop() moves the element
+ * straight out (no std::optional) and T needs no default constructor. On top of push/pop it has
+ * batches (push_n/pop_n) and in-place access (reserve/commit, claim/release).
+ */
+template <typename T, size_t N>
+class SlotBoundedBuffer
+{
+public:
+    /// A ring slot handed out by reserve() or claim(). Valid until commit() / release().
+    class Slot
+    {
+    public:
+        T& operator*() const { return *m_value; }
+        T* operator->() const { return m_value; }
+
+    private:
+        friend class SlotBoundedBuffer;
+        Slot(T* value, size_t pos): m_value(value), m_pos(pos) {}
+        T* m_value;
+        size_t m_pos;
+    };
+
+    SlotBoundedBuffer() = default;
+    SlotBoundedBuffer(const SlotBoundedBuffer&) = delete;
+    SlotBoundedBuffer& operator=(const SlotBoundedBuffer&) = delete;
+
+    ~SlotBoundedBuffer()
+    {
+        for(size_t i=0; i<N; ++i)
+        {
+            if(m_state[i] != SlotState::Free && m_state[i] != SlotState::Skipped)
+            {
+                slot_ptr(i)->~T();
+            }
+        }
+    }
+
+    void push(const T& data)
+    {
+        do_push(data);
+    }
+    void push(T&& data)
+    {
+        do_push(std::forward<T>(data));
+    }
+
+    T pop()
+    {
+        m_data_full.acquire();
+        size_t freed = 0;
+        std::unique_lock lock(m_data_mutex);
+        try{
+            // No std::optional needed anymore, the element is moved straight out of its slot.
+            T data = take_locked(freed);
+            lock.unlock();
+            release_empty(freed);
+            return data;
+        }
+        catch(...){
+            if(lock.owns_lock())
+            {
+                lock.unlock();
+            }
+            // take_locked may have stepped over holes before the move threw, those are free now.
+            release_empty(freed);
+            m_data_full.release();
+            throw;
+        }
+    }
+
+    /**
+     * BATCHES: push_n / pop_n move a whole span but take the mutex once per chunk instead of once per
+     * element, and signal the other side with a single release(k) instead of k release() calls.
+     * A chunk is whatever is available right now (at least one element), so a batch larger than N
+     * still works, it just goes through in several chunks.
+     */
+    void push_n(std::span<const T> items)
+    {
+        size_t done = 0;
+        while(done < items.size())
+        {
+            size_t k = acquire_up_to(m_data_empty, items.size() - done);
+            size_t written = 0;
+            size_t published = 0;
+            {
+                std::unique_lock lock(m_data_mutex);
+                try{
+                    for(; written<k; ++written)
+                    {
+                        new (slot_ptr(m_write_pos)) T(items[done + written]);
+                        m_state[m_write_pos % N] = SlotState::Written;
+                        ++m_write_pos;
+                    }
+                }
+                catch(...){
+                    published = publish_locked();
+                    lock.unlock();
+                    release_full(published);
+                    release_empty(k - written);
+                    throw;
+                }
+                published = publish_locked();
+            }
+            release_full(published);
+            done += k;
+        }
+    }
+
+    /// Fills the whole span, blocking until enough elements arrived.
+    void pop_n(std::span<T> out)
+    {
+        size_t done = 0;
+        while(done < out.size())
+        {
+            size_t k = acquire_up_to(m_data_full, out.size() - done);
+            size_t consumed = 0;
+            size_t freed = 0;
+            {
+                std::unique_lock lock(m_data_mutex);
+                try{
+                    while(consumed < k)
+                    {
+                        // The slot is gone once take_locked returns: count it before the assignment
+                        // can throw, or its permit would go back to m_data_full.
+                        T data = take_locked(freed);
+                        ++consumed;
+                        out[done + consumed - 1] = std::move(data);
+                    }
+                }
+                catch(...){
+                    lock.unlock();
+                    release_empty(freed);
+                    release_full(k - consumed);
+                    throw;
+                }
+            }
+            release_empty(freed);
+            done += k;
+        }
+    }
+
+    /**
+     * ZERO-COPY: the producer constructs the element directly in its ring slot and fills it in
+     * place, the consumer reads it in place. Nothing is copied or moved, which matters for big
+     * message types.
+     *
+     *   auto slot = buffer.reserve(args...);  // constructs T(args...) in the slot
+     *   slot->field = ...;                    // outside the lock
+     *   buffer.commit(slot);
+     *
+     *   auto slot = buffer.claim();
+     *   use(*slot);                           // outside the lock
+     *   buffer.release(slot);                 // destroys the element, frees the slot
+     *
+     * reserve() without arguments default-initializes, so a trivial T isn't zero-filled first. The
+     * element is constructed after the lock is dropped: the slot already belongs to the caller.
+     *
+     * Several producers (consumers) may hold slots at the same time and commit (release) them in
+     * any order. Consumers only ever see the contiguous committed prefix of the ring: m_publish_pos
+     * advances over committed slots and stops at the first one still being written. m_free_pos
+     * does the same for released slots, so the ring order is kept.
+     */
+    template <typename... CtorArgs>
+    Slot reserve(CtorArgs&&... args)
+    {
+        m_data_empty.acquire();
+        size_t pos = 0;
+        {
+            std::unique_lock lock(m_data_mutex);
+            m_state[m_write_pos % N] = SlotState::Writing;
+            pos = m_write_pos++;
+        }
+
+        T* value = slot_ptr(pos);
+        try{
+            if constexpr(sizeof...(CtorArgs) == 0)
+            {
+                new (value) T;
+            }
+            else
+            {
+                new (value) T(std::forward<CtorArgs>(args)...);
+            }
+        }
+        catch(...){
+            // Later producers may have committed already, so the slot can't be handed back. It is
+            // published as a hole. If nothing unread is in front of it, it is freed right here,
+            // otherwise the consumer that takes the element in front of it steps over it.
+            size_t published = 0;
+            size_t freed = 0;
+            {
+                std::unique_lock lock(m_data_mutex);
+                m_state[pos % N] = SlotState::Skipped;
+                published = publish_locked();
+                freed = skip_locked();
+            }
+            release_full(published);
+            release_empty(freed);
+            throw;
+        }
+        return Slot{value, pos};
+    }
+
+    void commit(const Slot& slot)
+    {
+        size_t published = 0;
+        {
+            std::unique_lock lock(m_data_mutex);
+            m_state[slot.m_pos % N] = SlotState::Written;
+            published = publish_locked();
+        }
+        release_full(published);
+    }
+
+    Slot claim()
+    {
+        m_data_full.acquire();
+        size_t freed = 0;
+        size_t pos = 0;
+        {
+            std::unique_lock lock(m_data_mutex);
+            freed = skip_locked();
+            m_state[m_read_pos % N] = SlotState::Reading;
+            pos = m_read_pos++;
+            freed += skip_locked();
+        }
+        release_empty(freed);
+        return Slot{slot_ptr(pos), pos};
+    }
+
+    void release(const Slot& slot)
+    {
+        // The slot is ours until it's marked Free, so destroy it outside the lock.
+        slot.m_value->~T();
+        size_t freed = 0;
+        {
+            std::unique_lock lock(m_data_mutex);
+            m_state[slot.m_pos % N] = SlotState::Free;
+            freed = free_locked();
+        }
+        release_empty(freed);
+    }
+
+private:
+    /// Skipped: reserved, but constructing the element threw. Holds no element.
+    enum class SlotState : unsigned char { Free, Writing, Written, Skipped, Reading };
+
+    /// Raw storage so that elements can be constructed in place (and T needs no default constructor).
+    struct Storage
+    {
+        alignas(T) std::byte bytes[sizeof(T)];
+    };
+
+    std::array<Storage, N> m_data;
+    std::array<SlotState, N> m_state{};
+    std::mutex m_data_mutex;
+    // All positions only grow, the slot is pos % N.
+    // m_free_pos <= m_read_pos <= m_publish_pos <= m_write_pos
+    size_t m_write_pos{0};   // next slot a producer gets
+    size_t m_publish_pos{0}; // slots before it are committed and visible to consumers
+    size_t m_read_pos{0};    // next slot a consumer gets
+    size_t m_free_pos{0};    // slots before it are released and reusable by producers
+
+    std::counting_semaphore<N> m_data_full{0};
+    std::counting_semaphore<N> m_data_empty{N};
+
+    T* slot_ptr(size_t pos)
+    {
+        return std::launder(reinterpret_cast<T*>(m_data[pos % N].bytes));
+    }
+
+    // *_locked functions expect m_data_mutex to be held. They return how many slots became
+    // visible/free, the caller passes that on to the semaphore after unlocking.
+    size_t publish_locked()
+    {
+        size_t count = 0;
+        while(m_publish_pos < m_write_pos && (m_state[m_publish_pos % N] == SlotState::Written ||
+                                              m_state[m_publish_pos % N] == SlotState::Skipped))
+        {
+            // A skipped slot keeps the order but isn't an element, it gets no m_data_full permit.
+            count += m_state[m_publish_pos % N] == SlotState::Written;
+            ++m_publish_pos;
+        }
+        return count;
+    }
+
+    size_t free_locked()
+    {
+        size_t count = 0;
+        while(m_free_pos < m_read_pos && m_state[m_free_pos % N] == SlotState::Free)
+        {
+            ++m_free_pos;
+            ++count;
+        }
+        return count;
+    }
+
+    /// Steps m_read_pos over published skipped slots. Called whenever m_read_pos moves and when a
+    /// hole is published, so a hole never waits for an element that may never come: it only stays
+    /// while something unread or unpublished is in front of it.
+    size_t skip_locked()
+    {
+        while(m_read_pos < m_publish_pos && m_state[m_read_pos % N] == SlotState::Skipped)
+        {
+            m_state[m_read_pos % N] = SlotState::Free;
+            ++m_read_pos;
+        }
+        return free_locked();
+    }
+
+    T take_locked(size_t& freed)
+    {
+        freed += skip_locked();
+        T* slot = slot_ptr(m_read_pos);
+        T data{std::move(*slot)};
+        slot->~T();
+        m_state[m_read_pos % N] = SlotState::Free;
+        ++m_read_pos;
+        freed += skip_locked();
+        return data;
+    }
+
+    void release_full(size_t count)
+    {
+        if(count > 0)
+        {
+            m_data_full.release(static_cast<std::ptrdiff_t>(count));
+        }
+    }
+
+    void release_empty(size_t count)
+    {
+        if(count > 0)
+        {
+            m_data_empty.release(static_cast<std::ptrdiff_t>(count));
+        }
+    }
+
+    /// Blocks for one unit, then grabs up to max-1 more without blocking.
+    static size_t acquire_up_to(std::counting_semaphore<N>& semaphore, size_t max)
+    {
+        semaphore.acquire();
+        size_t count = 1;
+        while(count < max && semaphore.try_acquire())
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    void do_push(auto&& data)
+    {
+        /// NOTE: acquire reduces the counter.
+        m_data_empty.acquire();
+        size_t published = 0;
+        try{
+            std::unique_lock lock(m_data_mutex);
+            new (slot_ptr(m_write_pos)) T(std::forward<decltype(data)>(data));
+            m_state[m_write_pos % N] = SlotState::Written;
+            ++m_write_pos;
+            published = publish_locked();
+        }
+        catch(...)
+        {
+            m_data_empty.release();
+            throw;
+        }
+        release_full(published);
+    }
+};
+
 void producer(BoundedBuffer<int, 5>&buffer, int N=20)
 {
     for(int i=0; i<N; ++i)
@@ -98,8 +478,169 @@ void consumer(BoundedBuffer<int, 5>&buffer, int N=20)
     }
 }
 
+/**
+ * BENCHMARKS for the batch and zero-copy APIs against the plain BoundedBuffer, one producer and one
+ * consumer.
+ */
+template <typename F>
+double time_ms(F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void benchmark_batches(size_t items, size_t batch)
+{
+    BoundedBuffer<int, 1024> buffer;
+    SlotBoundedBuffer<int, 1024> slots;
+    long long sum = 0;
+    double single = time_ms([&](){
+        std::thread t{[&](){
+            for(size_t i=0; i<items; ++i)
+            {
+                buffer.push(static_cast<int>(i));
+            }
+        }};
+        for(size_t i=0; i<items; ++i)
+        {
+            sum += buffer.pop();
+        }
+        t.join();
+    });
+
+    long long batch_sum = 0;
+    double batched = time_ms([&](){
+        std::thread t{[&](){
+            std::vector<int> chunk(batch);
+            for(size_t i=0; i<items; i+=batch)
+            {
+                for(size_t j=0; j<batch; ++j)
+                {
+                    chunk[j] = static_cast<int>(i + j);
+                }
+                slots.push_n(chunk);
+            }
+        }};
+        std::vector<int> chunk(batch);
+        for(size_t i=0; i<items; i+=batch)
+        {
+            slots.pop_n(chunk);
+            for(int n : chunk)
+            {
+                batch_sum += n;
+            }
+        }
+        t.join();
+    });
+    LOG("BoundedBuffer push/pop: ", single, "ms, SlotBoundedBuffer push_n/pop_n(", batch, "): ", batched, "ms",
+        sum == batch_sum ? "" : "  WRONG SUM");
+}
+
+struct Message
+{
+    size_t id;
+    std::array<char, 4096> payload;
+};
+
+void benchmark_zero_copy(size_t items)
+{
+    // Heap allocated, 64 slots of 4KB is too much for the stack of main.
+    auto buffer = std::make_unique<BoundedBuffer<Message, 64>>();
+    auto slots = std::make_unique<SlotBoundedBuffer<Message, 64>>();
+    size_t checksum = 0;
+    double copying = time_ms([&](){
+        std::thread t{[&](){
+            Message message;
+            for(size_t i=0; i<items; ++i)
+            {
+                message.id = i;
+                message.payload.fill(static_cast<char>(i));
+                buffer->push(message);
+            }
+        }};
+        for(size_t i=0; i<items; ++i)
+        {
+            Message message = buffer->pop();
+            checksum += message.id + static_cast<unsigned char>(message.payload[100]);
+        }
+        t.join();
+    });
+
+    size_t zero_copy_checksum = 0;
+    double in_place = time_ms([&](){
+        std::thread t{[&](){
+            for(size_t i=0; i<items; ++i)
+            {
+                auto slot = slots->reserve();
+                slot->id = i;
+                slot->payload.fill(static_cast<char>(i));
+                slots->commit(slot);
+            }
+        }};
+        for(size_t i=0; i<items; ++i)
+        {
+            auto slot = slots->claim();
+            zero_copy_checksum += slot->id + static_cast<unsigned char>(slot->payload[100]);
+            slots->release(slot);
+        }
+        t.join();
+    });
+    LOG("4KB messages BoundedBuffer push/pop: ", copying, "ms, SlotBoundedBuffer reserve/commit + claim/release: ", in_place, "ms",
+        checksum == zero_copy_checksum ? "" : "  WRONG CHECKSUM");
+}
+
+/// A hole must not keep its slot: after `N` failed reserve() calls the buffer still takes N elements.
+struct Boom
+{
+    int value;
+    Boom(): value(0) { throw std::runtime_error("Boom"); }
+    explicit Boom(int v): value(v) {}
+};
+
+void check_throwing_reserve()
+{
+    SlotBoundedBuffer<Boom, 2> buffer;
+    for(int i=0; i<2; ++i)
+    {
+        try
+        {
+            buffer.reserve();
+        }
+        catch(const std::runtime_error&)
+        {
+        }
+    }
+    buffer.push(Boom{7});
+    buffer.push(Boom{8});
+    int first = buffer.pop().value;
+    int second = buffer.pop().value;
+
+    // A hole behind an unread element is freed by the consumer that takes the element.
+    buffer.push(Boom{9});
+    try
+    {
+        buffer.reserve();
+    }
+    catch(const std::runtime_error&)
+    {
+    }
+    int third = buffer.pop().value;
+    buffer.push(Boom{10});
+    buffer.push(Boom{11});
+    int fourth = buffer.pop().value;
+    int fifth = buffer.pop().value;
+    bool ok = first == 7 && second == 8 && third == 9 && fourth == 10 && fifth == 11;
+    LOG("Throwing reserve(): ", ok ? "slots recovered" : "WRONG ORDER");
+}
+
 int main(int argc, char** argv)
 {
+    check_throwing_reserve();
+    benchmark_batches(1000000, 64);
+    benchmark_zero_copy(200000);
+
     BoundedBuffer<int, 5> buffer;
     std::thread t1{producer, std::ref(buffer), 20};
     std::thread t2{consumer, std::ref(buffer), 20};
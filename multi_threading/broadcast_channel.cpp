@@ -0,0 +1,429 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * BROADCAST CHANNEL
+ * publisher/subscriber in conditional_vars.cpp share one global std::queue and one condition_variable:
+ * every publish takes the mutex and wakes a thread, and a message goes to exactly one subscriber.
+ *
+ * BroadcastChannel<T> delivers every message to every subscriber:
+ *  - One ring of slots shared by everybody. A message is written once, each subscriber keeps its own
+ *    cursor (the position of the next message it wants to read). Nothing is copied per subscriber.
+ *  - publish() claims a position with one fetch_add and publishes the slot through its sequence
+ *    number, no mutex. Per slot:  seq == 2*pos + 1 -> being written,  seq == 2*pos + 2 -> message pos
+ *    is readable. A reader copies the slot and re-checks seq afterwards (seqlock style, see
+ *    rw_locks.cpp), so a copy that raced a writer is detected and never returned.
+ *  - Subscribers spin (then yield) for new messages instead of sleeping on a condition_variable:
+ *    a futex wakeup alone costs microseconds, this is a low latency channel. It also means every
+ *    subscriber wants a core of its own: on an oversubscribed machine the spinners steal time from
+ *    the publisher and the condition_variable version wins.
+ *
+ * LAG POLICY for a subscriber that falls a full ring behind:
+ *  - Block:      the publisher waits until the slowest subscriber has read the slot it is about to
+ *                reuse. Nobody loses messages, one slow subscriber slows everybody down.
+ *  - DropOldest: the publisher never waits. A lapped subscriber notices (seq is from a later lap),
+ *                jumps forward to the oldest message still in the ring and counts what it missed.
+ *
+ * T must be trivially copyable: a reader may copy a slot while it is overwritten and throw the
+ * copy away. The slot is kept in atomic words for the same reason SeqLock does it.
+ */
+
+enum class LagPolicy { Block, DropOldest };
+
+template <typename T>
+class BroadcastChannel
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Slots are copied byte-wise and may be overwritten");
+
+public:
+    class Subscriber;
+
+    BroadcastChannel(size_t capacity, LagPolicy policy):
+        m_capacity(std::bit_ceil(std::max<size_t>(capacity, 2))),
+        m_mask(m_capacity - 1),
+        m_policy(policy),
+        m_slots(std::make_unique<Slot[]>(m_capacity))
+    {}
+
+    BroadcastChannel(const BroadcastChannel&) = delete;
+    BroadcastChannel& operator=(const BroadcastChannel&) = delete;
+
+    void publish(const T& value)
+    {
+        std::uint64_t pos = m_claim.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = m_slots[pos & m_mask];
+
+        if(pos >= m_capacity)
+        {
+            if(m_policy == LagPolicy::Block)
+            {
+                wait_for_subscribers(pos - m_capacity);
+            }
+            // Another publisher may still be writing the previous lap of this slot.
+            std::uint64_t previous = 2 * (pos - m_capacity) + 2;
+            while(slot.seq.load(std::memory_order_acquire) < previous)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.store(value);
+        slot.seq.store(2 * pos + 2, std::memory_order_release);
+    }
+
+    /// New subscribers start with the next message published.
+    Subscriber subscribe()
+    {
+        std::lock_guard lock(m_subscribe_mutex);
+        for(size_t i=0; i<MAX_SUBSCRIBERS; ++i)
+        {
+            if(!m_cursors[i].active.load(std::memory_order_relaxed))
+            {
+                m_cursors[i].position.store(m_claim.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                m_cursors[i].active.store(true, std::memory_order_seq_cst);
+                return Subscriber{*this, i};
+            }
+        }
+        throw std::runtime_error("Too many subscribers");
+    }
+
+    class Subscriber
+    {
+    public:
+        Subscriber(Subscriber&& other) noexcept:
+            m_channel(std::exchange(other.m_channel, nullptr)), m_index(other.m_index), m_dropped(other.m_dropped)
+        {}
+        Subscriber(const Subscriber&) = delete;
+        Subscriber& operator=(const Subscriber&) = delete;
+
+        ~Subscriber()
+        {
+            if(m_channel)
+            {
+                m_channel->m_cursors[m_index].active.store(false, std::memory_order_release);
+            }
+        }
+
+        /// nullopt if there is no new message yet.
+        std::optional<T> try_receive()
+        {
+            auto& cursor = m_channel->m_cursors[m_index].position;
+            std::uint64_t pos = cursor.load(std::memory_order_relaxed);
+            while(true)
+            {
+                Slot& slot = m_channel->m_slots[pos & m_channel->m_mask];
+                std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+                if(seq < 2 * pos + 2)
+                {
+                    return std::nullopt; // not published yet (or still being written)
+                }
+                if(seq == 2 * pos + 2)
+                {
+                    T value = slot.load();
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if(slot.seq.load(std::memory_order_relaxed) == seq)
+                    {
+                        cursor.store(pos + 1, std::memory_order_release);
+                        return value;
+                    }
+                }
+                // Lapped: the slot holds a newer message. Skip to the oldest one still in the ring.
+                std::uint64_t newest = m_channel->m_claim.load(std::memory_order_acquire);
+                std::uint64_t oldest = newest > m_channel->m_capacity ? newest - m_channel->m_capacity : 0;
+                // Give the publisher that is about to overwrite oldest a slot of head room.
+                oldest = std::min(oldest + 1, newest);
+                if(oldest > pos)
+                {
+                    m_dropped += oldest - pos;
+                    pos = oldest;
+                }
+            }
+        }
+
+        /// Spins for a while, then yields, until a message arrives.
+        T receive()
+        {
+            for(int spins=0; ; ++spins)
+            {
+                if(auto value = try_receive())
+                {
+                    return *value;
+                }
+                if(spins > 100)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        /// Messages skipped because this subscriber was lapped (DropOldest only).
+        std::uint64_t dropped() const { return m_dropped; }
+
+    private:
+        friend class BroadcastChannel;
+        Subscriber(BroadcastChannel& channel, size_t index): m_channel(&channel), m_index(index) {}
+
+        BroadcastChannel* m_channel;
+        size_t m_index;
+        std::uint64_t m_dropped{0};
+    };
+
+private:
+    static constexpr size_t MAX_SUBSCRIBERS = 64;
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> seq{0};
+        std::array<std::atomic<std::uint64_t>, WORDS> words{};
+
+        T load() const
+        {
+            std::array<std::uint64_t, WORDS> raw;
+            for(size_t i=0; i<WORDS; ++i)
+            {
+                raw[i] = words[i].load(std::memory_order_relaxed);
+            }
+            T value;
+            std::memcpy(&value, raw.data(), sizeof(T));
+            return value;
+        }
+
+        void store(const T& value)
+        {
+            std::array<std::uint64_t, WORDS> raw{};
+            std::memcpy(raw.data(), &value, sizeof(T));
+            for(size_t i=0; i<WORDS; ++i)
+            {
+                words[i].store(raw[i], std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /// Written by one subscriber, read by Block publishers. One cache line each.
+    struct alignas(64) Cursor
+    {
+        std::atomic<std::uint64_t> position{0};
+        std::atomic<bool> active{false};
+    };
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    const LagPolicy m_policy;
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<std::uint64_t> m_claim{0};
+    std::array<Cursor, MAX_SUBSCRIBERS> m_cursors;
+    std::mutex m_subscribe_mutex; // subscribe() only, never taken by publish()
+
+    /// Block policy: wait until every active subscriber has read message `pos`.
+    void wait_for_subscribers(std::uint64_t pos)
+    {
+        for(auto& cursor : m_cursors)
+        {
+            while(cursor.active.load(std::memory_order_acquire) &&
+                  cursor.position.load(std::memory_order_acquire) <= pos)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+/**
+ * The conditional_vars.cpp design made broadcast: a queue, mutex and condition_variable per subscriber,
+ * publish locks each one and notifies.
+ */
+template <typename T>
+class CondVarBroadcast
+{
+public:
+    explicit CondVarBroadcast(size_t subscribers): m_queues(subscribers) {}
+
+    void publish(const T& value)
+    {
+        for(auto& queue : m_queues)
+        {
+            {
+                std::scoped_lock lock{queue.mutex};
+                queue.items.push_back(value);
+            }
+            queue.cv.notify_one();
+        }
+    }
+
+    T receive(size_t subscriber)
+    {
+        auto& queue = m_queues[subscriber];
+        std::unique_lock lock(queue.mutex);
+        queue.cv.wait(lock, [&queue](){ return !queue.items.empty(); });
+        T value = queue.items.front();
+        queue.items.pop_front();
+        return value;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<T> items;
+    };
+    std::vector<Queue> m_queues;
+};
+
+/**
+ * BENCHMARK: one publisher sends a timestamped message every ~5us, every subscriber records
+ * receive time - publish time.
+ */
+struct Tick
+{
+    std::int64_t sent_ns;
+    std::uint64_t sequence;
+};
+
+std::int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void print_percentiles(const char* label, std::vector<std::int64_t>& latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))] / 1000.0;
+    };
+    LOG(label, ": p50 ", at(0.50), "us, p90 ", at(0.90), "us, p99 ", at(0.99), "us, p99.9 ", at(0.999),
+        "us, max ", latencies.back() / 1000.0, "us");
+}
+
+void pace(std::chrono::microseconds gap)
+{
+    auto until = std::chrono::steady_clock::now() + gap;
+    while(std::chrono::steady_clock::now() < until) {}
+}
+
+template <typename Receive, typename Publish>
+void measure(const char* label, size_t subscribers, size_t messages, Receive&& receive, Publish&& publish)
+{
+    std::vector<std::vector<std::int64_t>> latencies(subscribers);
+    std::vector<std::thread> threads;
+    for(size_t s=0; s<subscribers; ++s)
+    {
+        threads.emplace_back([&, s](){
+            latencies[s].reserve(messages);
+            for(size_t i=0; i<messages; ++i)
+            {
+                Tick tick = receive(s);
+                latencies[s].push_back(now_ns() - tick.sent_ns);
+            }
+        });
+    }
+    for(size_t i=0; i<messages; ++i)
+    {
+        publish(Tick{now_ns(), i});
+        pace(std::chrono::microseconds(5));
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+
+    std::vector<std::int64_t> all;
+    for(auto& l : latencies)
+    {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    print_percentiles(label, all);
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t subscribers = 2;
+    constexpr size_t messages = 20000;
+
+    {
+        CondVarBroadcast<Tick> baseline(subscribers);
+        measure("mutex + condition_variable", subscribers, messages,
+                [&](size_t s) { return baseline.receive(s); },
+                [&](const Tick& tick) { baseline.publish(tick); });
+    }
+    {
+        BroadcastChannel<Tick> channel(1024, LagPolicy::Block);
+        // Subscribe before anything is published so nobody misses the first message.
+        std::vector<BroadcastChannel<Tick>::Subscriber> subs;
+        for(size_t s=0; s<subscribers; ++s)
+        {
+            subs.push_back(channel.subscribe());
+        }
+        measure("BroadcastChannel          ", subscribers, messages,
+                [&](size_t s) { return subs[s].receive(); },
+                [&](const Tick& tick) { channel.publish(tick); });
+    }
+
+    // Lag policy with one slow subscriber.
+    for(LagPolicy policy : {LagPolicy::Block, LagPolicy::DropOldest})
+    {
+        BroadcastChannel<Tick> channel(256, policy);
+        auto fast = channel.subscribe();
+        auto slow = channel.subscribe();
+        constexpr size_t count = 20000;
+
+        std::atomic<bool> done{false};
+        std::uint64_t fast_received = 0;
+        std::uint64_t slow_received = 0;
+        std::thread fast_thread{[&](){
+            while(fast_received + fast.dropped() < count)
+            {
+                if(fast.try_receive()) { ++fast_received; } else { std::this_thread::yield(); }
+            }
+        }};
+        std::thread slow_thread{[&](){
+            while(true)
+            {
+                if(slow.try_receive()) { ++slow_received; pace(std::chrono::microseconds(20)); }
+                else if(done) { break; }
+                else { std::this_thread::yield(); }
+            }
+        }};
+
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i=0; i<count; ++i)
+        {
+            channel.publish(Tick{now_ns(), i});
+        }
+        std::chrono::duration<double, std::milli> publish_time = std::chrono::steady_clock::now() - start;
+        fast_thread.join();
+        done = true;
+        slow_thread.join();
+
+        LOG(policy == LagPolicy::Block ? "Block     " : "DropOldest", ": published ", count, " in ",
+            publish_time.count(), "ms, fast got ", fast_received, " (dropped ", fast.dropped(), "), slow got ",
+            slow_received, " (dropped ", slow.dropped(), ")");
+    }
+    return 0;
+}
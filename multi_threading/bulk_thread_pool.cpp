@@ -0,0 +1,330 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <latch>
+#include <memory>
+#include <ranges>
+#include <algorithm>
+#include <numeric>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * BULK SUBMISSION
+ * N calls to enqueue() = N lock round trips + N notify_one() calls. Two additions to ThreadPool:
+ *
+ *  1. enqueue_bulk(range): wraps every callable first (allocations happen outside the lock), then
+ *     pushes the whole batch under ONE lock and wakes the workers once.
+ *
+ *  2. parallel_for(begin, end, grain, fn): splits [begin, end) into chunks of `grain` indices.
+ *     Instead of one task per chunk, it enqueues at most one "runner" per worker. Runners (and the
+ *     calling thread itself) keep claiming the next chunk with an atomic fetch_add until none are
+ *     left. Because the caller also runs chunks, calling parallel_for from inside a task can not
+ *     deadlock the pool.
+ */
+
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        /// NOTE: shared_ptr is used here so that we can share ownership between
+        /// worker thread and pool.
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push([task]() { (*task)(); });
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+    /// Enqueue every callable in `tasks` with a single lock and a single wake up.
+    template <std::ranges::input_range Range>
+    auto enqueue_bulk(Range&& tasks)
+        -> std::vector<std::future<std::invoke_result_t<std::ranges::range_value_t<Range>&>>>
+    {
+        using ReturnType = std::invoke_result_t<std::ranges::range_value_t<Range>&>;
+
+        std::vector<std::future<ReturnType>> results;
+        std::vector<std::function<void()>> batch;
+        if constexpr(std::ranges::sized_range<Range>)
+        {
+            results.reserve(std::ranges::size(tasks));
+            batch.reserve(std::ranges::size(tasks));
+        }
+        for(auto&& func : tasks)
+        {
+            auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                    std::forward<decltype(func)>(func));
+            results.push_back(task->get_future());
+            batch.push_back([task]() { (*task)(); });
+        }
+
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+            for(auto& task : batch)
+            {
+                m_task_queue.push(std::move(task));
+            }
+        }
+        wake(batch.size());
+        return results;
+    }
+
+    /**
+     * Calls fn(i) for every i in [begin, end), `grain` consecutive indices per chunk.
+     * Blocks until all chunks are done and rethrows the first exception thrown by fn.
+     */
+    template <typename Index, typename F>
+    void parallel_for(Index begin, Index end, Index grain, F&& fn)
+    {
+        if(!(begin < end))
+        {
+            return;
+        }
+        grain = std::max<Index>(grain, 1);
+        const size_t num_chunks = static_cast<size_t>((end - begin + grain - 1) / grain);
+
+        /// NOTE: Runners may start after parallel_for has returned (all chunks already claimed),
+        /// so the bookkeeping is shared. fn itself is only touched for claimed chunks, which all
+        /// finish before we return, so pointing at the caller's fn is safe.
+        struct Shared
+        {
+            std::atomic<size_t> next_chunk{0};
+            std::atomic<size_t> done_chunks{0};
+            std::mutex error_mutex;
+            std::exception_ptr error;
+        };
+        auto shared = std::make_shared<Shared>();
+        const size_t total = num_chunks;
+        auto* body = &fn;
+
+        auto run_chunks = [shared, body, begin, end, grain, total]() {
+            while(true)
+            {
+                size_t chunk = shared->next_chunk.fetch_add(1, std::memory_order_relaxed);
+                if(chunk >= total)
+                {
+                    return;
+                }
+                Index first = begin + static_cast<Index>(chunk) * grain;
+                Index last = (end - first > grain) ? first + grain : end;
+                try
+                {
+                    for(Index i = first; i < last; ++i)
+                    {
+                        (*body)(i);
+                    }
+                }
+                catch(...)
+                {
+                    std::lock_guard lock(shared->error_mutex);
+                    if(!shared->error)
+                    {
+                        shared->error = std::current_exception();
+                    }
+                }
+                if(shared->done_chunks.fetch_add(1, std::memory_order_acq_rel) + 1 == total)
+                {
+                    shared->done_chunks.notify_all();
+                }
+            }
+        };
+
+        // One runner per worker at most; the calling thread is the extra one.
+        const size_t num_runners = std::min(num_chunks - 1, m_workers.size());
+        if(num_runners > 0)
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+            for(size_t i=0; i<num_runners; ++i)
+            {
+                m_task_queue.push(run_chunks);
+            }
+        }
+        wake(num_runners);
+
+        run_chunks();
+        size_t done = shared->done_chunks.load(std::memory_order_acquire);
+        while(done != total)
+        {
+            shared->done_chunks.wait(done, std::memory_order_acquire);
+            done = shared->done_chunks.load(std::memory_order_acquire);
+        }
+
+        if(shared->error)
+        {
+            std::rethrow_exception(shared->error);
+        }
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void wake(size_t num_tasks)
+    {
+        if(num_tasks >= m_workers.size())
+        {
+            m_queue_cv.notify_all();
+            return;
+        }
+        for(size_t i=0; i<num_tasks; ++i)
+        {
+            m_queue_cv.notify_one();
+        }
+    }
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+/**
+ * BENCHMARK: nanoseconds of overhead per task.
+ *  1. loop of enqueue() vs one enqueue_bulk() for the same tiny tasks.
+ *  2. one enqueue() per index vs parallel_for with a grain of 1024 indices.
+ */
+double ns_per_task(std::chrono::steady_clock::duration elapsed, size_t num_tasks)
+{
+    return std::chrono::duration<double, std::nano>(elapsed).count() / num_tasks;
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t num_tasks = 200000;
+    ThreadPool pool(4);
+    std::atomic<size_t> counter{0};
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::future<void>> results;
+        results.reserve(num_tasks);
+        for(size_t i=0; i<num_tasks; ++i)
+        {
+            results.push_back(pool.enqueue([&counter](){ counter.fetch_add(1, std::memory_order_relaxed); }));
+        }
+        for(auto& result: results)
+        {
+            result.get();
+        }
+        LOG("enqueue loop:    ", ns_per_task(std::chrono::steady_clock::now() - start, num_tasks), " ns/task");
+    }
+
+    {
+        std::vector<std::function<void()>> tasks(num_tasks, [&counter](){ counter.fetch_add(1, std::memory_order_relaxed); });
+        auto start = std::chrono::steady_clock::now();
+        auto results = pool.enqueue_bulk(tasks);
+        for(auto& result: results)
+        {
+            result.get();
+        }
+        LOG("enqueue_bulk:    ", ns_per_task(std::chrono::steady_clock::now() - start, num_tasks), " ns/task");
+    }
+
+    std::vector<double> data(num_tasks, 1.0);
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::future<void>> results;
+        results.reserve(data.size());
+        for(size_t i=0; i<data.size(); ++i)
+        {
+            results.push_back(pool.enqueue([&data, i](){ data[i] *= 2.0; }));
+        }
+        for(auto& result: results)
+        {
+            result.get();
+        }
+        LOG("enqueue per idx: ", ns_per_task(std::chrono::steady_clock::now() - start, data.size()), " ns/index");
+    }
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        pool.parallel_for(size_t{0}, data.size(), size_t{1024}, [&data](size_t i){ data[i] *= 2.0; });
+        LOG("parallel_for:    ", ns_per_task(std::chrono::steady_clock::now() - start, data.size()), " ns/index");
+    }
+
+    LOG("counter ", counter.load(), " (expected ", 2 * num_tasks, "), sum ",
+        std::accumulate(data.begin(), data.end(), 0.0), " (expected ", 4.0 * data.size(), ")");
+    return 0;
+}
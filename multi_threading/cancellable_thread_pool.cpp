@@ -0,0 +1,323 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stop_token>
+#include <type_traits>
+#include <tuple>
+#include <string>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * COOPERATIVE CANCELLATION AND GRACEFUL DRAIN
+ * ~ThreadPool in thread_pool.cpp runs EVERYTHING still queued before it returns. With 100k queued
+ * tasks that's a long shutdown. Three ways to stop this pool:
+ *
+ *  1. ~CancellableThreadPool(): same as before, finish all queued work (drain without a timeout).
+ *  2. drain(timeout): stop accepting tasks and let the queue empty out. If that takes longer than
+ *     timeout, fall back to shutdown_now().
+ *  3. shutdown_now(): stop accepting tasks, throw away everything still queued (their futures
+ *     throw TaskCancelled) and ask running tasks to stop.
+ *
+ * Running tasks can't be killed, they have to cooperate. Same idea as talker_non_stop in
+ * simple_threads.cpp: workers are std::jthreads and a task that takes a std::stop_token as its first
+ * parameter gets its worker's token and can poll stop_requested().
+ *
+ * condition_variable_any::wait(lock, stop_token, pred) is the C++20 piece that makes this easy: a
+ * stop request wakes the waiting worker by itself, no extra flag + notify needed.
+ */
+
+struct TaskCancelled : std::runtime_error
+{
+    TaskCancelled(): std::runtime_error("Task cancelled before it started") {}
+};
+
+class CancellableThreadPool
+{
+public:
+    CancellableThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::jthread{
+                [this](std::stop_token stoken){ worker(stoken);}
+            });
+        }
+    }
+
+    ~CancellableThreadPool()
+    {
+        /// NOTE: std::jthread's own destructor would request_stop() first and leave the queue behind,
+        /// so finish the work and join explicitly.
+        close();
+        join_all();
+    }
+
+    /// f may take a std::stop_token as first parameter, it then receives its worker's token.
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args)
+    {
+        using Fn = std::decay_t<F>;
+        constexpr bool wants_token = std::is_invocable_v<Fn&, std::stop_token, Args&...>;
+        using ReturnType = typename std::conditional_t<wants_token,
+                                                       std::invoke_result<Fn&, std::stop_token, Args&...>,
+                                                       std::invoke_result<Fn&, Args&...>>::type;
+
+        /// NOTE: A promise instead of a packaged_task so a dropped task can report TaskCancelled.
+        auto promise = std::make_shared<std::promise<ReturnType>>();
+        std::future<ReturnType> result = promise->get_future();
+
+        /// NOTE: std::bind can't leave a hole for the token in front of the bound args, so keep
+        /// the args in a tuple and std::apply them.
+        Task task = [promise, fn = Fn(std::forward<F>(func)), bound = std::make_tuple(std::move(args)...)]
+                    (std::stop_token stoken, bool cancelled) mutable {
+            if(cancelled)
+            {
+                promise->set_exception(std::make_exception_ptr(TaskCancelled{}));
+                return;
+            }
+            try
+            {
+                auto call = [&]() -> ReturnType {
+                    if constexpr(wants_token)
+                    {
+                        return std::apply([&](auto&... a) { return std::invoke(fn, stoken, a...); }, bound);
+                    }
+                    else
+                    {
+                        return std::apply([&](auto&... a) { return std::invoke(fn, a...); }, bound);
+                    }
+                };
+                if constexpr(std::is_void_v<ReturnType>)
+                {
+                    call();
+                    promise->set_value();
+                }
+                else
+                {
+                    promise->set_value(call());
+                }
+            }
+            catch(...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        };
+
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_closing)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push_back(std::move(task));
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+    /**
+     * Stops accepting tasks and waits up to `timeout` for queued and running tasks to finish.
+     * Returns true if everything finished, false if it had to fall back to shutdown_now().
+     */
+    template <typename Rep, typename Period>
+    bool drain(std::chrono::duration<Rep, Period> timeout)
+    {
+        close();
+        bool finished = false;
+        {
+            std::unique_lock lock(m_queue_mutex);
+            finished = m_idle_cv.wait_for(lock, timeout, [this](){
+                return m_task_queue.empty() && m_active == 0;
+            });
+        }
+        if(!finished)
+        {
+            shutdown_now();
+            return false;
+        }
+        join_all();
+        return true;
+    }
+
+    /// Drops every queued task, asks running tasks to stop and joins the workers.
+    /// Returns how many queued tasks were dropped.
+    size_t shutdown_now()
+    {
+        std::deque<Task> dropped;
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_closing = true;
+            dropped.swap(m_task_queue);
+        }
+        for(auto& worker : m_workers)
+        {
+            worker.request_stop(); // Also wakes workers blocked in m_queue_cv.wait.
+        }
+        for(auto& task : dropped)
+        {
+            task(std::stop_token{}, true);
+        }
+        join_all();
+        return dropped.size();
+    }
+
+private:
+    using Task = std::function<void(std::stop_token, bool cancelled)>;
+
+    std::vector<std::jthread> m_workers;
+    std::deque<Task> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable_any m_queue_cv;
+    std::condition_variable m_idle_cv;
+    size_t m_active{0};
+    bool m_closing{false};
+
+    void close()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_closing = true;
+        }
+        m_queue_cv.notify_all();
+    }
+
+    void join_all()
+    {
+        for(auto& worker : m_workers)
+        {
+            if(worker.joinable())
+            {
+                worker.join();
+            }
+        }
+    }
+
+    void worker(std::stop_token stoken)
+    {
+        while(true)
+        {
+            Task task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                // Returns false when a stop was requested, true when the predicate holds.
+                bool has_work = m_queue_cv.wait(lock, stoken, [this](){
+                    return m_closing || !m_task_queue.empty();
+                });
+                if(!has_work || m_task_queue.empty())
+                {
+                    return; // Stop requested, or closing with nothing left.
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop_front();
+                ++m_active;
+            }
+
+            task(stoken, false);
+
+            {
+                std::lock_guard lock(m_queue_mutex);
+                --m_active;
+                if(m_task_queue.empty() && m_active == 0)
+                {
+                    m_idle_cv.notify_all();
+                }
+            }
+        }
+    }
+};
+
+/// About `micros` of busy work that gives up early when asked to stop.
+void busy_work(std::stop_token stoken, int micros)
+{
+    auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(micros);
+    while(std::chrono::steady_clock::now() < until)
+    {
+        if(stoken.stop_requested())
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * BENCHMARK: shutdown latency with 100k tasks queued, measured from the moment shutdown starts.
+ */
+template <typename Shutdown>
+void measure_shutdown(const char* label, size_t num_tasks, Shutdown&& shutdown)
+{
+    auto pool = std::make_unique<CancellableThreadPool>(4);
+    std::vector<std::future<void>> results;
+    results.reserve(num_tasks);
+    for(size_t i=0; i<num_tasks; ++i)
+    {
+        results.push_back(pool->enqueue(busy_work, 5));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string detail = shutdown(pool);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t cancelled = 0;
+    for(auto& result: results)
+    {
+        try
+        {
+            result.get();
+        }
+        catch(const TaskCancelled&)
+        {
+            ++cancelled;
+        }
+    }
+    LOG(label, ": ", elapsed.count(), "ms, ", cancelled, " of ", num_tasks, " cancelled", detail);
+}
+
+int main(int argc, char** argv)
+{
+    using namespace std::chrono_literals;
+    constexpr size_t num_tasks = 100000;
+
+    measure_shutdown("destructor (run everything)", num_tasks, [](auto& pool) {
+        pool.reset();
+        return std::string{};
+    });
+    measure_shutdown("drain(20ms)", num_tasks, [](auto& pool) {
+        bool finished = pool->drain(20ms);
+        return std::string{finished ? ", drained" : ", timed out -> shutdown_now"};
+    });
+    measure_shutdown("shutdown_now()", num_tasks, [](auto& pool) {
+        size_t dropped = pool->shutdown_now();
+        return ", dropped " + std::to_string(dropped);
+    });
+
+    // A long running task notices the stop request through its token.
+    CancellableThreadPool pool(2);
+    auto long_task = pool.enqueue([](std::stop_token stoken){
+        int rounds = 0;
+        while(!stoken.stop_requested())
+        {
+            std::this_thread::sleep_for(1ms);
+            ++rounds;
+        }
+        return rounds;
+    });
+    std::this_thread::sleep_for(20ms);
+    pool.shutdown_now();
+    LOG("Long task stopped after ", long_task.get(), " rounds");
+    return 0;
+}
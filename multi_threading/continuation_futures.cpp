@@ -0,0 +1,468 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
+#include <variant>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * CONTINUATIONS
+ * std::future only offers get(), which parks the calling thread. For fan-out/fan-in we would need a
+ * blocked thread per join, and inside the pool that is how deadlocks start.
+ *
+ * PoolFuture<T> instead lets you say what should happen NEXT:
+ *  - f.then(g):         when f is ready, run g(value) as a new task on the pool.
+ *  - when_all(futures): ready once every input is ready (fails with the first error).
+ *  - when_any(futures): ready once the first input is ready, holds its index.
+ *
+ * Shared state: value/exception + a list of callbacks. Whoever comes second (the producer setting the
+ * value, or the consumer adding a callback) runs the callback, so nothing is ever lost.
+ * Callbacks only post work to the pool; nobody waits.
+ *
+ * PoolFuture is copyable like std::shared_future, so when_all/when_any can take the futures by
+ * reference and the caller can still read the results afterwards.
+ */
+
+template <typename T>
+class PoolFuture;
+
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        /// NOTE: shared_ptr is used here so that we can share ownership between
+        /// worker thread and pool.
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        post([task]() { (*task)(); });
+        return result;
+    }
+
+    /// Like enqueue, but the result is a PoolFuture that supports then()/when_all()/when_any().
+    template <typename F, typename... Args>
+    auto submit(F&& func, Args... args) -> PoolFuture<decltype(func(args...))>;
+
+    /// Fire and forget: the bare minimum void() version from thread_pool.cpp.
+    void post(std::function<void()> task)
+    {
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push(std::move(task));
+        }
+        m_queue_cv.notify_one();
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+template <typename T>
+struct FutureState
+{
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool ready{false};
+    std::optional<Value> value;
+    std::exception_ptr error;
+    std::vector<std::function<void()>> callbacks;
+
+    template <typename... V>
+    void set_value(V&&... v)
+    {
+        finish([&](){ value.emplace(std::forward<V>(v)...); });
+    }
+
+    void set_exception(std::exception_ptr e)
+    {
+        finish([&](){ error = std::move(e); });
+    }
+
+    /// Runs callback right away if the state is ready, otherwise once it becomes ready.
+    void on_ready(std::function<void()> callback)
+    {
+        {
+            std::lock_guard lock(mutex);
+            if(!ready)
+            {
+                callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+private:
+    template <typename Store>
+    void finish(Store&& store)
+    {
+        std::vector<std::function<void()>> to_run;
+        {
+            std::lock_guard lock(mutex);
+            store();
+            ready = true;
+            to_run.swap(callbacks);
+        }
+        cv.notify_all();
+        // Run callbacks outside the lock: they may register more callbacks on this same state.
+        for(auto& callback : to_run)
+        {
+            callback();
+        }
+    }
+};
+
+/// Runs func(args...) and stores the result (or exception) in state.
+/// NOTE: set_value stays outside the try block, otherwise an exception from a callback would try
+/// to complete the same state a second time.
+template <typename T, typename F, typename... Args>
+void fulfil(FutureState<T>& state, F& func, Args&&... args)
+{
+    std::optional<typename FutureState<T>::Value> result;
+    try
+    {
+        if constexpr(std::is_void_v<T>)
+        {
+            func(std::forward<Args>(args)...);
+            result.emplace();
+        }
+        else
+        {
+            result.emplace(func(std::forward<Args>(args)...));
+        }
+    }
+    catch(...)
+    {
+        state.set_exception(std::current_exception());
+        return;
+    }
+    state.set_value(std::move(*result));
+}
+
+template <typename T>
+class PoolFuture
+{
+public:
+    using Value = typename FutureState<T>::Value;
+
+    PoolFuture(ThreadPool& pool, std::shared_ptr<FutureState<T>> state):
+        m_pool(&pool),
+        m_state(std::move(state))
+    {}
+
+    bool is_ready() const
+    {
+        std::lock_guard lock(m_state->mutex);
+        return m_state->ready;
+    }
+
+    /// Blocking, for the edges of the program (e.g. main). Inside the pool use then().
+    void wait() const
+    {
+        std::unique_lock lock(m_state->mutex);
+        m_state->cv.wait(lock, [this](){ return m_state->ready; });
+    }
+
+    decltype(auto) get() const
+    {
+        wait();
+        if(m_state->error)
+        {
+            std::rethrow_exception(m_state->error);
+        }
+        if constexpr(!std::is_void_v<T>)
+        {
+            return static_cast<const T&>(*m_state->value);
+        }
+    }
+
+    /**
+     * Schedules func onto the pool once this future is ready. func gets `const T&` (nothing for
+     * void). If this future failed, func is skipped and the error is forwarded. If the pool is
+     * already shutting down by then, func never runs and the result fails with broken_promise.
+     */
+    template <typename F>
+    auto then(F&& func) const
+    {
+        using Next = decltype(call(func, std::declval<const Value&>()));
+        auto next = std::make_shared<FutureState<Next>>();
+        auto state = m_state;
+        ThreadPool* pool = m_pool;
+
+        m_state->on_ready([pool, state, next, func = std::forward<F>(func)]() mutable {
+            // This runs inside set_value/set_exception of the previous state, often on a worker.
+            // An exception escaping from here would end in std::terminate.
+            try
+            {
+                pool->post([state, next, func = std::move(func)]() mutable {
+                    if(state->error)
+                    {
+                        next->set_exception(state->error);
+                        return;
+                    }
+                    auto invoke = [&](const Value& value){ return call(func, value); };
+                    fulfil(*next, invoke, *state->value);
+                });
+            }
+            catch(...)
+            {
+                next->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+        });
+        return PoolFuture<Next>{*m_pool, next};
+    }
+
+    ThreadPool& pool() const
+    {
+        return *m_pool;
+    }
+
+    const std::shared_ptr<FutureState<T>>& state() const
+    {
+        return m_state;
+    }
+
+private:
+    ThreadPool* m_pool;
+    std::shared_ptr<FutureState<T>> m_state;
+
+    template <typename F>
+    static decltype(auto) call(F& func, const Value& value)
+    {
+        if constexpr(std::is_void_v<T>)
+        {
+            return func();
+        }
+        else
+        {
+            return func(value);
+        }
+    }
+};
+
+template <typename F, typename... Args>
+auto ThreadPool::submit(F&& func, Args... args) -> PoolFuture<decltype(func(args...))>
+{
+    using ReturnType = decltype(func(args...));
+
+    auto state = std::make_shared<FutureState<ReturnType>>();
+    post([state, bound = std::bind(std::forward<F>(func), std::forward<Args>(args)...)]() mutable {
+        fulfil(*state, bound);
+    });
+    return PoolFuture<ReturnType>{*this, state};
+}
+
+/// Ready once every future is ready. Values stay in the input futures; read them with get().
+template <typename T>
+PoolFuture<void> when_all(ThreadPool& pool, const std::vector<PoolFuture<T>>& futures)
+{
+    auto result = std::make_shared<FutureState<void>>();
+    if(futures.empty())
+    {
+        result->set_value();
+        return PoolFuture<void>{pool, result};
+    }
+
+    struct Join
+    {
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::exception_ptr error;
+    };
+    auto join = std::make_shared<Join>();
+    join->remaining = futures.size();
+
+    for(const auto& future : futures)
+    {
+        auto state = future.state();
+        state->on_ready([state, join, result]() {
+            if(state->error)
+            {
+                std::lock_guard lock(join->mutex);
+                if(!join->error)
+                {
+                    join->error = state->error;
+                }
+            }
+            if(join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                join->error ? result->set_exception(join->error) : result->set_value();
+            }
+        });
+    }
+    return PoolFuture<void>{pool, result};
+}
+
+/// Ready once the first future is ready; holds that future's index.
+template <typename T>
+PoolFuture<size_t> when_any(ThreadPool& pool, const std::vector<PoolFuture<T>>& futures)
+{
+    auto result = std::make_shared<FutureState<size_t>>();
+    auto claimed = std::make_shared<std::atomic<bool>>(false);
+    for(size_t i=0; i<futures.size(); ++i)
+    {
+        futures[i].state()->on_ready([i, claimed, result]() {
+            if(!claimed->exchange(true, std::memory_order_acq_rel))
+            {
+                result->set_value(i);
+            }
+        });
+    }
+    return PoolFuture<size_t>{pool, result};
+}
+
+/**
+ * DEMO: fan-out/fan-in. Each request fans out to `fan_out` sub tasks and a when_all(...).then(...)
+ * combines them. No worker ever blocks, so thousands of requests are in flight on a 4 thread pool
+ * and only main() waits, once, at the very end.
+ */
+int main(int argc, char** argv)
+{
+    ThreadPool pool(4);
+
+    auto chained = pool.submit([](int a){ return a * 2; }, 20)
+                       .then([](const int& v){ return v + 2; })
+                       .then([](const int& v){ return std::to_string(v); });
+    LOG("Chained result: ", chained.get());
+
+    auto failing = pool.submit([](){ throw std::runtime_error("Divide by Zero Exception"); return 0; })
+                       .then([](const int& v){ return v + 1; });
+    try
+    {
+        failing.get();
+    }
+    catch(const std::exception& e)
+    {
+        LOG("Caught through then(): ", e.what());
+    }
+
+    // A chain still pending when its pool shuts down: the continuation can't be posted anymore.
+    std::optional<PoolFuture<int>> orphaned;
+    {
+        ThreadPool short_lived(1);
+        orphaned = short_lived.submit([](){ std::this_thread::sleep_for(std::chrono::milliseconds(50)); return 1; })
+                       .then([](const int& v){ return v + 1; });
+    }
+    try
+    {
+        orphaned->get();
+    }
+    catch(const std::future_error& e)
+    {
+        LOG("Pool stopped before then(): ", e.what());
+    }
+
+    constexpr size_t num_requests = 2000;
+    constexpr size_t fan_out = 8;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<PoolFuture<long>> requests;
+    for(size_t r=0; r<num_requests; ++r)
+    {
+        auto parts = std::make_shared<std::vector<PoolFuture<long>>>();
+        for(size_t p=0; p<fan_out; ++p)
+        {
+            parts->push_back(pool.submit([r, p](){ return static_cast<long>(r * p); }));
+        }
+        requests.push_back(when_all(pool, *parts).then([parts](){
+            long sum = 0;
+            for(auto& part : *parts)
+            {
+                sum += part.get(); // Already ready: never blocks.
+            }
+            return sum;
+        }));
+    }
+
+    auto fastest = when_any(pool, requests);
+    when_all(pool, requests).wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    long total = 0;
+    for(auto& request : requests)
+    {
+        total += request.get();
+    }
+    LOG(num_requests, " requests x ", fan_out, " sub tasks in ", elapsed.count() * 1000, "ms, total ", total,
+        ", first finished request ", fastest.get());
+    return 0;
+}
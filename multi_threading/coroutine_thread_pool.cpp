@@ -0,0 +1,509 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
+#include <variant>
+#include <coroutine>
+#include <semaphore>
+#include <latch>
+#include <utility>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * C++20 COROUTINES ON A ThreadPool
+ * A coroutine is a function that can suspend (co_await) and be resumed later, possibly on another
+ * thread. Its locals live in a heap "frame", not on a thread stack, so a suspended coroutine costs a
+ * few hundred bytes instead of a whole blocked thread.
+ *
+ * Pieces:
+ *  1. Task<T>: lazy coroutine. Nothing runs until somebody co_awaits it. When it finishes it resumes
+ *     the awaiting coroutine directly (symmetric transfer, no extra trip through the pool).
+ *  2. schedule_on(pool): co_await it to hop onto a pool worker. await_suspend posts handle.resume().
+ *  3. pool.enqueue_async(f, args...): like enqueue, but awaitable. The worker that runs f resumes
+ *     the waiting coroutine itself.
+ *  4. AsyncEvent: coroutines wait on it without a thread; set() posts them all back to the pool.
+ *  5. sync_wait(task): the only blocking call, for main().
+ *
+ * Every coroutine needs a promise_type that tells the compiler:
+ *  - get_return_object(): what the caller gets back.
+ *  - initial_suspend():   start right away (suspend_never) or lazily (suspend_always).
+ *  - final_suspend():     what happens after co_return.
+ *  - return_value/return_void and unhandled_exception().
+ */
+
+template <typename T>
+class AsyncResult;
+
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        /// NOTE: shared_ptr is used here so that we can share ownership between
+        /// worker thread and pool.
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        post([task]() { (*task)(); });
+        return result;
+    }
+
+    /// Like enqueue, but the result is co_await-able instead of get()-able.
+    template <typename F, typename... Args>
+    auto enqueue_async(F&& func, Args... args) -> AsyncResult<decltype(func(args...))>;
+
+    /// Fire and forget: the bare minimum void() version from thread_pool.cpp.
+    void post(std::function<void()> task)
+    {
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push(std::move(task));
+        }
+        m_queue_cv.notify_one();
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+/// co_await schedule_on(pool) -> the rest of the coroutine runs on a pool worker.
+auto schedule_on(ThreadPool& pool)
+{
+    struct Awaiter
+    {
+        ThreadPool& pool;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { pool.post([handle]() { handle.resume(); }); }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{pool};
+}
+
+/**
+ * Result of enqueue_async. `waiter` is the only synchronization between the worker and the awaiting
+ * coroutine: nullptr (nobody waits yet), a coroutine address (somebody waits) or done_marker().
+ */
+template <typename T>
+class AsyncResult
+{
+public:
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    struct State
+    {
+        std::optional<Value> value;
+        std::exception_ptr error;
+        std::atomic<void*> waiter{nullptr};
+
+        void complete()
+        {
+            void* previous = waiter.exchange(done_marker(), std::memory_order_acq_rel);
+            if(previous)
+            {
+                std::coroutine_handle<>::from_address(previous).resume();
+            }
+        }
+    };
+
+    explicit AsyncResult(std::shared_ptr<State> state): m_state(std::move(state)) {}
+
+    bool await_ready() const noexcept
+    {
+        return m_state->waiter.load(std::memory_order_acquire) == done_marker();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        void* expected = nullptr;
+        // Fails only if the worker finished in the meantime: then don't suspend at all.
+        return m_state->waiter.compare_exchange_strong(expected, handle.address(), std::memory_order_acq_rel);
+    }
+
+    T await_resume()
+    {
+        if(m_state->error)
+        {
+            std::rethrow_exception(m_state->error);
+        }
+        if constexpr(!std::is_void_v<T>)
+        {
+            return std::move(*m_state->value);
+        }
+    }
+
+private:
+    std::shared_ptr<State> m_state;
+
+    static void* done_marker()
+    {
+        static char marker;
+        return &marker;
+    }
+};
+
+template <typename F, typename... Args>
+auto ThreadPool::enqueue_async(F&& func, Args... args) -> AsyncResult<decltype(func(args...))>
+{
+    using ReturnType = decltype(func(args...));
+    using State = typename AsyncResult<ReturnType>::State;
+
+    auto state = std::make_shared<State>();
+    post([state, bound = std::bind(std::forward<F>(func), std::forward<Args>(args)...)]() mutable {
+        try
+        {
+            if constexpr(std::is_void_v<ReturnType>)
+            {
+                bound();
+                state->value.emplace();
+            }
+            else
+            {
+                state->value.emplace(bound());
+            }
+        }
+        catch(...)
+        {
+            state->error = std::current_exception();
+        }
+        state->complete();
+    });
+    return AsyncResult<ReturnType>{state};
+}
+
+template <typename T>
+class Task;
+
+/// return_value and return_void can't live in the same promise, hence the void specialization.
+template <typename T>
+struct TaskPromiseBase
+{
+    std::optional<T> value;
+    void return_value(T v) { value.emplace(std::move(v)); }
+};
+
+template <>
+struct TaskPromiseBase<void>
+{
+    void return_void() {}
+};
+
+template <typename T>
+class Task
+{
+public:
+    struct promise_type : TaskPromiseBase<T>
+    {
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object()
+        {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                // Symmetric transfer: jump straight back into whoever awaited us.
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept: m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&) = delete;
+
+    ~Task()
+    {
+        if(m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().continuation = awaiting;
+        return m_handle; // Start the lazy task now, on this thread.
+    }
+
+    T await_resume()
+    {
+        auto& promise = m_handle.promise();
+        if(promise.error)
+        {
+            std::rethrow_exception(promise.error);
+        }
+        if constexpr(!std::is_void_v<T>)
+        {
+            return std::move(*promise.value);
+        }
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+
+    explicit Task(std::coroutine_handle<promise_type> handle): m_handle(handle) {}
+};
+
+/// Eager, fire-and-forget coroutine. The frame destroys itself when it finishes.
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/// Coroutines wait on the event without holding a thread; set() posts all of them to the pool.
+class AsyncEvent
+{
+public:
+    explicit AsyncEvent(ThreadPool& pool): m_pool(pool) {}
+
+    void set()
+    {
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard lock(m_mutex);
+            m_set = true;
+            waiters.swap(m_waiters);
+        }
+        for(auto handle : waiters)
+        {
+            m_pool.post([handle]() { handle.resume(); });
+        }
+    }
+
+    auto operator co_await()
+    {
+        struct Awaiter
+        {
+            AsyncEvent& event;
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                std::lock_guard lock(event.m_mutex);
+                if(event.m_set)
+                {
+                    return false;
+                }
+                event.m_waiters.push_back(handle);
+                return true;
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+private:
+    ThreadPool& m_pool;
+    std::mutex m_mutex;
+    bool m_set{false};
+    std::vector<std::coroutine_handle<>> m_waiters;
+};
+
+/// Blocks the calling (non-pool) thread until task is done.
+template <typename T>
+T sync_wait(Task<T> task)
+{
+    std::binary_semaphore done{0};
+    std::optional<typename AsyncResult<T>::Value> value;
+    std::exception_ptr error;
+
+    auto runner = [](Task<T>& task, std::binary_semaphore& done, auto& value, std::exception_ptr& error) -> Detached {
+        try
+        {
+            if constexpr(std::is_void_v<T>)
+            {
+                co_await task;
+                value.emplace();
+            }
+            else
+            {
+                value.emplace(co_await task);
+            }
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+        done.release();
+    };
+    runner(task, done, value, error);
+    done.acquire();
+
+    if(error)
+    {
+        std::rethrow_exception(error);
+    }
+    if constexpr(!std::is_void_v<T>)
+    {
+        return std::move(*value);
+    }
+}
+
+// NOTE: Coroutine parameters are copied into the frame, but references stay references. Everything
+// passed by reference below lives in main() and outlives the coroutines.
+Task<int> double_on_pool(ThreadPool& pool, int value)
+{
+    co_await schedule_on(pool);
+    co_return value * 2;
+}
+
+Task<int> add_on_pool(ThreadPool& pool, int a, int b)
+{
+    co_await schedule_on(pool);
+    int doubled = co_await double_on_pool(pool, a);
+    int sum = co_await pool.enqueue_async([](int x, int y){ return x + y; }, doubled, b);
+    co_return sum;
+}
+
+Detached handler(ThreadPool& pool, AsyncEvent& gate, int id, std::atomic<int>& waiting,
+                 std::atomic<long>& total, std::latch& done)
+{
+    co_await schedule_on(pool);
+    waiting.fetch_add(1, std::memory_order_relaxed);
+    co_await gate; // Parked here with no thread attached.
+    int value = co_await pool.enqueue_async([id](){ return id; });
+    total.fetch_add(co_await double_on_pool(pool, value), std::memory_order_relaxed);
+    done.count_down();
+}
+
+int main(int argc, char** argv)
+{
+    ThreadPool pool(4);
+
+    LOG("add_on_pool(10, 22) = ", sync_wait(add_on_pool(pool, 10, 22)));
+
+    auto failing = []() -> Task<int> { throw std::runtime_error("Divide by Zero Exception"); co_return 0; };
+    try
+    {
+        sync_wait(failing());
+    }
+    catch(const std::exception& e)
+    {
+        LOG("Caught ", e.what());
+    }
+
+    // Tens of thousands of in-flight handlers on 4 threads.
+    constexpr int num_handlers = 50000;
+    AsyncEvent gate{pool};
+    std::atomic<int> waiting{0};
+    std::atomic<long> total{0};
+    std::latch done{num_handlers};
+
+    auto start = std::chrono::steady_clock::now();
+    for(int id=0; id<num_handlers; ++id)
+    {
+        handler(pool, gate, id, waiting, total, done);
+    }
+    while(waiting.load() != num_handlers)
+    {
+        std::this_thread::yield();
+    }
+    LOG(waiting.load(), " handlers suspended at the same time on ", 4, " threads");
+    gate.set();
+    done.wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    LOG("All handlers done in ", elapsed.count() * 1000, "ms, total ", total.load(),
+        " (expected ", static_cast<long>(num_handlers) * (num_handlers - 1), ")");
+    return 0;
+}
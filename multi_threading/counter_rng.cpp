@@ -0,0 +1,387 @@
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <array>
+#include <vector>
+#include <span>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <cstdint>
+#include <algorithm>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * COUNTER-BASED RANDOM NUMBERS (Philox4x32-10, Salmon et al. "Parallel Random Numbers: As Easy as 1, 2, 3")
+ * random_int in fork-join.cpp keeps a thread_local engine seeded from std::random_device and builds a
+ * distribution per call. Two problems for Monte Carlo:
+ *  - Results depend on which thread drew which number, so they change with the thread count (and
+ *    with random_device, on every run).
+ *  - A sequential engine can't jump ahead cheaply and can't produce 8 numbers at once.
+ *
+ * A counter-based generator is a pure function:  random_block = philox(counter, key)
+ *  - key     = the seed.
+ *  - counter = (block index within the stream, stream id). Number i of stream s is the same no
+ *              matter who asks for it or when.
+ *  - No state besides the counter, so skipping ahead is just setting the counter, and any number of
+ *    blocks can be computed independently, side by side.
+ *
+ * Philox rounds only use 32x32->64 bit multiplies and xors. fill_* computes LANES blocks at once with
+ * the four words in separate arrays (structure of arrays), so the inner loops are plain
+ * element-wise loops that the compiler turns into SIMD without any intrinsics (GCC 12 does it at
+ * -O2 already, -march=native gets the wider registers).
+ *
+ * REPRODUCIBLE PARALLEL MONTE CARLO: split the samples into fixed CHUNKS, chunk c always uses stream
+ * c, and combine the chunk results in chunk order. Threads only decide who computes which chunk,
+ * which no longer affects any number, so the result is bit-identical for 1 or 64 threads.
+ */
+
+namespace philox
+{
+    constexpr uint32_t M0 = 0xD2511F53;
+    constexpr uint32_t M1 = 0xCD9E8D57;
+    constexpr uint32_t W0 = 0x9E3779B9; // golden ratio
+    constexpr uint32_t W1 = 0xBB67AE85; // sqrt(3) - 1
+    constexpr int ROUNDS = 10;
+
+    using Block = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+
+    /// One Philox4x32-10 block, the reference (one block at a time) version.
+    constexpr Block generate(Block counter, Key key)
+    {
+        for(int round=0; round<ROUNDS; ++round)
+        {
+            uint64_t product0 = static_cast<uint64_t>(M0) * counter[0];
+            uint64_t product1 = static_cast<uint64_t>(M1) * counter[2];
+            counter = Block{
+                static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+                static_cast<uint32_t>(product1),
+                static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+                static_cast<uint32_t>(product0)
+            };
+            key[0] += W0;
+            key[1] += W1;
+        }
+        return counter;
+    }
+
+    // Known answer tests from the Random123 distribution.
+    static_assert(generate({0, 0, 0, 0}, {0, 0}) == Block{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+    static_assert(generate({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff})
+                  == Block{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+}
+
+/// 4 x 32 bits -> 2 doubles in [0, 1) with 53 random bits each.
+inline double to_unit(uint32_t high, uint32_t low)
+{
+    uint64_t bits = (static_cast<uint64_t>(high) << 32) | low;
+    return static_cast<double>(bits >> 11) * 0x1.0p-53;
+}
+
+class RandomStream
+{
+public:
+    static constexpr size_t LANES = 16;
+
+    RandomStream(uint64_t seed, uint64_t stream):
+        m_key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+        m_stream(stream)
+    {}
+
+    /// Jump to block `block` of this stream (4 x 32 bits per block). O(1).
+    void seek(uint64_t block)
+    {
+        m_block = block;
+        m_buffered = 0;
+    }
+
+    uint32_t next_u32()
+    {
+        if(m_buffered == 0)
+        {
+            m_buffer = philox::generate(counter(m_block++), m_key);
+            m_buffered = 4;
+        }
+        return m_buffer[4 - m_buffered--];
+    }
+
+    /// Uniform in [min, max], Lemire's multiply + shift with rejection (no modulo bias, no division
+    /// on the common path).
+    int uniform_int(int min, int max)
+    {
+        uint32_t range = static_cast<uint32_t>(max) - static_cast<uint32_t>(min) + 1;
+        if(range == 0)
+        {
+            return static_cast<int>(next_u32()); // full 32 bit range
+        }
+        uint64_t product = static_cast<uint64_t>(next_u32()) * range;
+        auto low = static_cast<uint32_t>(product);
+        if(low < range)
+        {
+            uint32_t threshold = -range % range;
+            while(low < threshold)
+            {
+                product = static_cast<uint64_t>(next_u32()) * range;
+                low = static_cast<uint32_t>(product);
+            }
+        }
+        // Add in uint32_t: min + offset can exceed INT_MAX in int (e.g. min < 0, range > 2^31).
+        return static_cast<int>(static_cast<uint32_t>(min) + static_cast<uint32_t>(product >> 32));
+    }
+
+    /**
+     * Fills `out` with uniforms in [0, 1). Stream layout, which reproducibility depends on:
+     *  - The call starts on a block boundary: words next_u32 still has buffered are discarded.
+     *  - It works in batches of LANES blocks and always consumes whole batches, i.e.
+     *    ceil(out.size() / (2 * LANES)) * LANES blocks, even when the last batch is only partly used.
+     *  - Within batch b starting at block k, out[2 * LANES * b + 2 * j] comes from words 0-1 and
+     *    out[2 * LANES * b + 2 * j + 1] from words 2-3 of block k + j.
+     * So two calls of n values do not give the same numbers as one call of 2n unless n is a
+     * multiple of 2 * LANES.
+     */
+    void fill_uniform(std::span<double> out)
+    {
+        m_buffered = 0; // batches always start on a block boundary
+        Lanes lanes;
+        size_t i = 0;
+        // Whole batches: a straight loop over the lanes, vectorized like generate_lanes.
+        for(; i + 2 * LANES <= out.size(); i += 2 * LANES)
+        {
+            generate_lanes(lanes);
+            double* dst = out.data() + i;
+            for(size_t lane=0; lane<LANES; ++lane)
+            {
+                dst[2 * lane] = to_unit(lanes.w0[lane], lanes.w1[lane]);
+                dst[2 * lane + 1] = to_unit(lanes.w2[lane], lanes.w3[lane]);
+            }
+        }
+        if(i < out.size())
+        {
+            generate_lanes(lanes);
+            for(size_t lane=0; i<out.size(); ++lane)
+            {
+                out[i++] = to_unit(lanes.w0[lane], lanes.w1[lane]);
+                if(i < out.size())
+                {
+                    out[i++] = to_unit(lanes.w2[lane], lanes.w3[lane]);
+                }
+            }
+        }
+    }
+
+    /// Standard normal variates, Box-Muller on pairs of uniforms. Same layout as fill_uniform; an odd
+    /// size takes the last variate from a second fill_uniform call, which consumes another LANES blocks.
+    void fill_normal(std::span<double> out)
+    {
+        fill_uniform(out);
+        for(size_t i=0; i+1<out.size(); i+=2)
+        {
+            double u1 = 1.0 - out[i]; // (0, 1], log(0) must not happen
+            double u2 = out[i + 1];
+            double radius = std::sqrt(-2.0 * std::log(u1));
+            double angle = 2.0 * std::numbers::pi * u2;
+            out[i] = radius * std::cos(angle);
+            out[i + 1] = radius * std::sin(angle);
+        }
+        if(out.size() % 2)
+        {
+            double extra[2];
+            fill_uniform(extra);
+            out.back() = std::sqrt(-2.0 * std::log(1.0 - extra[0])) * std::cos(2.0 * std::numbers::pi * extra[1]);
+        }
+    }
+
+private:
+    philox::Key m_key;
+    uint64_t m_stream;
+    uint64_t m_block{0};
+    philox::Block m_buffer{};
+    size_t m_buffered{0};
+
+    philox::Block counter(uint64_t block) const
+    {
+        return {static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32),
+                static_cast<uint32_t>(m_stream), static_cast<uint32_t>(m_stream >> 32)};
+    }
+
+    /// One array per word so every step below is an element-wise loop over lanes.
+    struct Lanes
+    {
+        alignas(64) uint32_t w0[LANES];
+        alignas(64) uint32_t w1[LANES];
+        alignas(64) uint32_t w2[LANES];
+        alignas(64) uint32_t w3[LANES];
+    };
+
+    /// LANES consecutive blocks, same rounds as philox::generate.
+    void generate_lanes(Lanes& c)
+    {
+        for(size_t lane=0; lane<LANES; ++lane)
+        {
+            uint64_t block = m_block + lane;
+            c.w0[lane] = static_cast<uint32_t>(block);
+            c.w1[lane] = static_cast<uint32_t>(block >> 32);
+            c.w2[lane] = static_cast<uint32_t>(m_stream);
+            c.w3[lane] = static_cast<uint32_t>(m_stream >> 32);
+        }
+        m_block += LANES;
+
+        uint32_t k0 = m_key[0];
+        uint32_t k1 = m_key[1];
+        for(int round=0; round<philox::ROUNDS; ++round)
+        {
+            for(size_t lane=0; lane<LANES; ++lane)
+            {
+                uint64_t product0 = static_cast<uint64_t>(philox::M0) * c.w0[lane];
+                uint64_t product1 = static_cast<uint64_t>(philox::M1) * c.w2[lane];
+                uint32_t next0 = static_cast<uint32_t>(product1 >> 32) ^ c.w1[lane] ^ k0;
+                uint32_t next2 = static_cast<uint32_t>(product0 >> 32) ^ c.w3[lane] ^ k1;
+                c.w1[lane] = static_cast<uint32_t>(product1);
+                c.w3[lane] = static_cast<uint32_t>(product0);
+                c.w0[lane] = next0;
+                c.w2[lane] = next2;
+            }
+            k0 += philox::W0;
+            k1 += philox::W1;
+        }
+    }
+};
+
+/// The fork-join.cpp version, for comparison.
+int random_int(int min, int max)
+{
+    static thread_local auto engine = std::default_random_engine(std::random_device{}());
+    auto dist = std::uniform_int_distribution<int>(min, max);
+    return dist(engine);
+}
+
+/**
+ * BENCHMARK 1: cost per number on one thread.
+ */
+template <typename F>
+double ns_per_call(size_t count, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / count;
+}
+
+/**
+ * BENCHMARK 2: Monte Carlo estimate of E[max(Z, 0)] for standard normal Z (exact 1/sqrt(2 pi)) with
+ * `num_threads` threads. Chunk c uses stream c and its partial sum lands in slot c, slots are added
+ * in chunk order at the end. Threads grab chunks dynamically, so who does what differs run to run.
+ */
+double monte_carlo(uint64_t seed, size_t num_threads, size_t chunks, size_t per_chunk)
+{
+    std::vector<double> partial(chunks);
+    std::atomic<size_t> next_chunk{0};
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<num_threads; ++t)
+    {
+        threads.emplace_back([&](){
+            std::vector<double> samples(per_chunk);
+            for(size_t c = next_chunk++; c < chunks; c = next_chunk++)
+            {
+                RandomStream stream(seed, c);
+                stream.fill_normal(samples);
+                double sum = 0.0;
+                for(double z : samples)
+                {
+                    sum += std::max(z, 0.0);
+                }
+                partial[c] = sum;
+            }
+        });
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+    double total = 0.0;
+    for(double sum : partial)
+    {
+        total += sum;
+    }
+    return total / (chunks * per_chunk);
+}
+
+/// Same estimate the fork-join.cpp way: thread_local engines, samples split by thread.
+double monte_carlo_thread_local(size_t num_threads, size_t samples)
+{
+    std::vector<double> partial(num_threads);
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<num_threads; ++t)
+    {
+        threads.emplace_back([&, t](){
+            static thread_local std::mt19937_64 engine{std::random_device{}()};
+            std::normal_distribution<double> normal;
+            double sum = 0.0;
+            for(size_t i=0; i<samples / num_threads; ++i)
+            {
+                sum += std::max(normal(engine), 0.0);
+            }
+            partial[t] = sum;
+        });
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+    double total = 0.0;
+    for(double sum : partial)
+    {
+        total += sum;
+    }
+    return total / (samples / num_threads * num_threads);
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t count = 10000000;
+    long long sink = 0;
+
+    double std_ns = ns_per_call(count, [&](){
+        for(size_t i=0; i<count; ++i) { sink += random_int(1, 6); }
+    });
+    RandomStream dice(42, 0);
+    double philox_ns = ns_per_call(count, [&](){
+        for(size_t i=0; i<count; ++i) { sink += dice.uniform_int(1, 6); }
+    });
+    std::vector<double> buffer(4096);
+    RandomStream batch(42, 1);
+    double uniform_ns = ns_per_call(count, [&](){
+        for(size_t i=0; i<count; i+=buffer.size()) { batch.fill_uniform(buffer); sink += buffer[7] > 0.5; }
+    });
+    double normal_ns = ns_per_call(count, [&](){
+        for(size_t i=0; i<count; i+=buffer.size()) { batch.fill_normal(buffer); sink += buffer[7] > 0.0; }
+    });
+    LOG("random_int (fork-join.cpp):        ", std_ns, " ns per number");
+    LOG("RandomStream::uniform_int:         ", philox_ns, " ns per number");
+    LOG("RandomStream::fill_uniform (batch): ", uniform_ns, " ns per number");
+    LOG("RandomStream::fill_normal (batch):  ", normal_ns, " ns per number");
+
+    // Same seed and stream always give the same numbers, wherever the counter starts.
+    RandomStream a(7, 3);
+    RandomStream b(7, 3);
+    b.seek(1000);
+    for(int i=0; i<4000; ++i) { a.next_u32(); }
+    LOG("seek(1000) matches 4000 draws: ", a.next_u32() == b.next_u32() ? "yes" : "NO");
+
+    LOG(std::setprecision(17));
+    LOG("Exact E[max(Z,0)] = ", 1.0 / std::sqrt(2.0 * std::numbers::pi));
+    for(size_t num_threads : {1, 2, 4, 8})
+    {
+        LOG(num_threads, " threads: philox streams ", monte_carlo(2024, num_threads, 256, 16384),
+            "   thread_local engines ", monte_carlo_thread_local(num_threads, 256 * 16384));
+    }
+    return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,308 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <semaphore>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <bit>
+#include <algorithm>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * RUNTIME SIZED BoundedBuffer
+ * BoundedBuffer<T, N> in bounded_buffer.cpp fixes N at compile time, indexes with "% N" and can only
+ * block. Here:
+ *  1. The capacity is a constructor argument, rounded up to a power of two so that "% N" becomes
+ *     "& m_mask" (a division is tens of cycles, an and is one).
+ *  2. try_push / try_pop never block, they report failure instead.
+ *  3. push_for / pop_for block for at most a timeout. A producer facing a slow consumer can drop
+ *     (or divert) the item instead of stalling forever: load shedding.
+ *
+ * Still the same two counting_semaphores: std::counting_semaphore<> (default, huge max) works with a
+ * runtime count, and try_acquire / try_acquire_for give us the non-blocking and timed variants for free.
+ */
+
+template <typename T>
+class DynamicBoundedBuffer
+{
+public:
+    explicit DynamicBoundedBuffer(size_t capacity):
+        m_capacity(std::bit_ceil(std::max<size_t>(capacity, 1))),
+        m_mask(m_capacity - 1),
+        m_data(std::make_unique<T[]>(m_capacity)),
+        m_data_empty(static_cast<std::ptrdiff_t>(m_capacity))
+    {}
+
+    DynamicBoundedBuffer(const DynamicBoundedBuffer&) = delete;
+    DynamicBoundedBuffer& operator=(const DynamicBoundedBuffer&) = delete;
+
+    size_t capacity() const { return m_capacity; }
+
+    void push(const T& data)
+    {
+        m_data_empty.acquire();
+        do_push(data);
+    }
+    void push(T&& data)
+    {
+        m_data_empty.acquire();
+        do_push(std::move(data));
+    }
+
+    bool try_push(const T& data)
+    {
+        if(!m_data_empty.try_acquire())
+        {
+            return false;
+        }
+        do_push(data);
+        return true;
+    }
+    bool try_push(T&& data)
+    {
+        if(!m_data_empty.try_acquire())
+        {
+            return false;
+        }
+        do_push(std::move(data));
+        return true;
+    }
+
+    /// On timeout `data` is left untouched, so the caller can still do something else with it.
+    template <typename Rep, typename Period>
+    bool push_for(T&& data, std::chrono::duration<Rep, Period> timeout)
+    {
+        if(!m_data_empty.try_acquire_for(timeout))
+        {
+            return false;
+        }
+        do_push(std::move(data));
+        return true;
+    }
+    template <typename Rep, typename Period>
+    bool push_for(const T& data, std::chrono::duration<Rep, Period> timeout)
+    {
+        if(!m_data_empty.try_acquire_for(timeout))
+        {
+            return false;
+        }
+        do_push(data);
+        return true;
+    }
+
+    T pop()
+    {
+        m_data_full.acquire();
+        return do_pop();
+    }
+
+    std::optional<T> try_pop()
+    {
+        if(!m_data_full.try_acquire())
+        {
+            return std::nullopt;
+        }
+        return do_pop();
+    }
+
+    template <typename Rep, typename Period>
+    std::optional<T> pop_for(std::chrono::duration<Rep, Period> timeout)
+    {
+        if(!m_data_full.try_acquire_for(timeout))
+        {
+            return std::nullopt;
+        }
+        return do_pop();
+    }
+
+private:
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<T[]> m_data;
+    std::mutex m_data_mutex;
+    size_t m_write_pos{0};
+    size_t m_read_pos{0};
+
+    std::counting_semaphore<> m_data_full{0};
+    std::counting_semaphore<> m_data_empty;
+
+    /// Expects one m_data_empty unit to be held already.
+    void do_push(auto&& data)
+    {
+        try{
+            std::unique_lock lock(m_data_mutex);
+            m_data[m_write_pos & m_mask] = std::forward<decltype(data)>(data);
+            ++m_write_pos;
+        }
+        catch(...)
+        {
+            m_data_empty.release();
+            throw;
+        }
+        m_data_full.release();
+    }
+
+    /// Expects one m_data_full unit to be held already.
+    T do_pop()
+    {
+        std::optional<T> data;
+        try{
+            std::unique_lock lock(m_data_mutex);
+            data = std::move(m_data[m_read_pos & m_mask]);
+            ++m_read_pos;
+        }
+        catch(...){
+            m_data_full.release();
+            throw;
+        }
+        m_data_empty.release();
+        return std::move(*data);
+    }
+};
+
+/**
+ * Latency histogram with power of two buckets: bucket i counts samples in [2^i, 2^(i+1)) ns.
+ * Percentiles are reported as the upper edge of the bucket, good enough to see orders of magnitude.
+ */
+class LatencyHistogram
+{
+public:
+    void record(std::chrono::nanoseconds latency)
+    {
+        auto ns = static_cast<unsigned long long>(std::max<long long>(latency.count(), 1));
+        size_t bucket = std::min<size_t>(std::bit_width(ns) - 1, BUCKETS - 1);
+        ++m_buckets[bucket];
+        ++m_count;
+        m_max = std::max(m_max, ns);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for(size_t i=0; i<BUCKETS; ++i)
+        {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        m_count += other.m_count;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    unsigned long long percentile(double p) const
+    {
+        auto target = static_cast<unsigned long long>(p * m_count);
+        unsigned long long seen = 0;
+        for(size_t i=0; i<BUCKETS; ++i)
+        {
+            seen += m_buckets[i];
+            if(seen > target)
+            {
+                return std::min(2ull << i, m_max);
+            }
+        }
+        return m_max;
+    }
+
+    void print(const char* label) const
+    {
+        LOG(label, ": p50 ", percentile(0.50) / 1000.0, "us, p99 ", percentile(0.99) / 1000.0,
+            "us, p99.9 ", percentile(0.999) / 1000.0, "us, max ", m_max / 1000.0, "us");
+    }
+
+private:
+    static constexpr size_t BUCKETS = 40;
+    std::array<unsigned long long, BUCKETS> m_buckets{};
+    unsigned long long m_count{0};
+    unsigned long long m_max{0};
+};
+
+/**
+ * BENCHMARK: overload. 4 producers push as fast as they can, one consumer needs ~20us per item, so
+ * the buffer is full nearly all the time. We record how long each push call takes.
+ */
+enum class PushMode { Blocking, Timed, Try };
+
+void overload(const char* label, PushMode mode, size_t per_producer)
+{
+    using namespace std::chrono_literals;
+    constexpr size_t producers = 4;
+    DynamicBoundedBuffer<int> buffer(100); // rounded up to 128
+
+    std::atomic<bool> done{false};
+    std::thread consumer{[&](){
+        while(true)
+        {
+            auto item = buffer.pop_for(10ms);
+            if(!item)
+            {
+                if(done)
+                {
+                    return;
+                }
+                continue;
+            }
+            auto until = std::chrono::steady_clock::now() + 20us;
+            while(std::chrono::steady_clock::now() < until) {}
+        }
+    }};
+
+    std::vector<LatencyHistogram> histograms(producers);
+    std::atomic<size_t> dropped{0};
+    std::vector<std::thread> threads;
+    for(size_t p=0; p<producers; ++p)
+    {
+        threads.emplace_back([&, p](){
+            size_t local_dropped = 0;
+            for(size_t i=0; i<per_producer; ++i)
+            {
+                int item = static_cast<int>(i);
+                auto start = std::chrono::steady_clock::now();
+                bool pushed = true;
+                switch(mode)
+                {
+                    case PushMode::Blocking: buffer.push(item); break;
+                    case PushMode::Timed:    pushed = buffer.push_for(item, 100us); break;
+                    case PushMode::Try:      pushed = buffer.try_push(item); break;
+                }
+                histograms[p].record(std::chrono::steady_clock::now() - start);
+                if(!pushed)
+                {
+                    ++local_dropped;
+                }
+            }
+            dropped += local_dropped;
+        });
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+    done = true;
+    consumer.join();
+
+    LatencyHistogram total;
+    for(const auto& histogram: histograms)
+    {
+        total.merge(histogram);
+    }
+    total.print(label);
+    LOG("    dropped ", dropped.load(), " of ", producers * per_producer);
+}
+
+int main(int argc, char** argv)
+{
+    DynamicBoundedBuffer<int> buffer(1000);
+    LOG("Asked for 1000 slots, got ", buffer.capacity());
+
+    overload("push()               ", PushMode::Blocking, 2000);
+    overload("push_for(100us)      ", PushMode::Timed, 2000);
+    overload("try_push()           ", PushMode::Try, 2000);
+    return 0;
+}
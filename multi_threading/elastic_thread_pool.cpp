@@ -0,0 +1,331 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <algorithm>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * ELASTIC ThreadPool
+ * Size the pool by load instead of at construction:
+ *  - GROW:   when the oldest queued task has waited longer than `grow_latency` and nobody is idle,
+ *            start one more worker (up to max_threads). Checked on every enqueue and by a small
+ *            supervisor thread, so a burst of long tasks is noticed even if nothing else is enqueued.
+ *  - SHRINK: a worker that found nothing to do for `idle_timeout` retires (down to min_threads).
+ *            Waiting uses wait_for instead of wait, that's the only change in the worker loop.
+ *
+ * A thread can not join itself, so a retiring worker moves its own std::thread into m_finished and
+ * somebody else (supervisor, next spawn, destructor) joins it.
+ */
+
+struct ElasticOptions
+{
+    size_t min_threads{1};
+    size_t max_threads{std::max(1u, std::thread::hardware_concurrency())};
+    std::chrono::steady_clock::duration grow_latency{std::chrono::milliseconds(5)};
+    std::chrono::steady_clock::duration idle_timeout{std::chrono::milliseconds(200)};
+};
+
+struct ResizeEvent
+{
+    std::chrono::steady_clock::time_point when;
+    size_t new_size;
+    bool grew;
+};
+
+struct ElasticMetrics
+{
+    size_t current_size{0};
+    size_t idle_workers{0};
+    size_t peak_size{0};
+    size_t grow_events{0};
+    size_t shrink_events{0};
+    size_t queue_depth{0};
+    std::vector<ResizeEvent> recent_events; // last MAX_EVENTS resizes
+};
+
+class ElasticThreadPool
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ElasticThreadPool(ElasticOptions options = {}):
+        m_options(options)
+    {
+        m_options.min_threads = std::max<size_t>(m_options.min_threads, 1);
+        m_options.max_threads = std::max(m_options.max_threads, m_options.min_threads);
+
+        std::lock_guard lock(m_queue_mutex);
+        for(size_t i=0; i<m_options.min_threads; ++i)
+        {
+            spawn_locked(false);
+        }
+        m_supervisor = std::thread{[this]{ supervise(); }};
+    }
+
+    ~ElasticThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+        m_supervisor_cv.notify_all();
+        m_supervisor.join();
+
+        // Workers may still retire while we wait, so take the threads out under the lock.
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard lock(m_queue_mutex);
+            for(auto& [id, thread] : m_workers)
+            {
+                threads.push_back(std::move(thread));
+            }
+            m_workers.clear();
+            for(auto& thread : m_finished)
+            {
+                threads.push_back(std::move(thread));
+            }
+            m_finished.clear();
+        }
+        for(auto& thread: threads)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        /// NOTE: shared_ptr is used here so that we can share ownership between
+        /// worker thread and pool.
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push_back(Task{[task]() { (*task)(); }, Clock::now()});
+            grow_if_needed_locked(Clock::now());
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+    ElasticMetrics metrics()
+    {
+        std::lock_guard lock(m_queue_mutex);
+        ElasticMetrics snapshot = m_metrics;
+        snapshot.current_size = m_workers.size();
+        snapshot.idle_workers = m_idle;
+        snapshot.queue_depth = m_task_queue.size();
+        snapshot.recent_events.assign(m_events.begin(), m_events.end());
+        return snapshot;
+    }
+
+    size_t size()
+    {
+        std::lock_guard lock(m_queue_mutex);
+        return m_workers.size();
+    }
+
+private:
+    static constexpr size_t MAX_EVENTS = 64;
+    /// Lower bound for the supervisor's poll interval: with grow_latency = 0 it would spin on m_queue_mutex.
+    static constexpr std::chrono::milliseconds MIN_POLL_INTERVAL{2};
+
+    struct Task
+    {
+        std::function<void()> run;
+        Clock::time_point enqueue_time;
+    };
+
+    ElasticOptions m_options;
+    std::unordered_map<size_t, std::thread> m_workers;
+    std::vector<std::thread> m_finished;
+    size_t m_next_worker_id{0};
+    size_t m_idle{0};
+    std::deque<Task> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    std::thread m_supervisor;
+    std::condition_variable m_supervisor_cv;
+
+    ElasticMetrics m_metrics;
+    std::deque<ResizeEvent> m_events;
+
+    // All *_locked functions expect m_queue_mutex to be held.
+    void record_locked(bool grew)
+    {
+        grew ? ++m_metrics.grow_events : ++m_metrics.shrink_events;
+        m_metrics.peak_size = std::max(m_metrics.peak_size, m_workers.size());
+        m_events.push_back(ResizeEvent{Clock::now(), m_workers.size(), grew});
+        if(m_events.size() > MAX_EVENTS)
+        {
+            m_events.pop_front();
+        }
+    }
+
+    void spawn_locked(bool record)
+    {
+        size_t id = m_next_worker_id++;
+        // Safe: the new worker needs m_queue_mutex before it can look at m_workers.
+        m_workers.emplace(id, std::thread{[this, id]{ worker(id); }});
+        if(record)
+        {
+            record_locked(true);
+        }
+        else
+        {
+            m_metrics.peak_size = std::max(m_metrics.peak_size, m_workers.size());
+        }
+    }
+
+    void grow_if_needed_locked(Clock::time_point now)
+    {
+        if(m_stop_flag || m_idle > 0 || m_task_queue.empty() || m_workers.size() >= m_options.max_threads)
+        {
+            return;
+        }
+        if(now - m_task_queue.front().enqueue_time >= m_options.grow_latency)
+        {
+            spawn_locked(true);
+        }
+    }
+
+    void reap_finished_locked(std::vector<std::thread>& out)
+    {
+        for(auto& thread : m_finished)
+        {
+            out.push_back(std::move(thread));
+        }
+        m_finished.clear();
+    }
+
+    void supervise()
+    {
+        std::unique_lock lock(m_queue_mutex);
+        while(!m_stop_flag)
+        {
+            m_supervisor_cv.wait_for(lock, std::max<Clock::duration>(m_options.grow_latency / 2, MIN_POLL_INTERVAL));
+            grow_if_needed_locked(Clock::now());
+
+            std::vector<std::thread> done;
+            reap_finished_locked(done);
+            lock.unlock();
+            for(auto& thread : done)
+            {
+                thread.join();
+            }
+            lock.lock();
+        }
+    }
+
+    void worker(size_t id)
+    {
+        while(true)
+        {
+            Task task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                ++m_idle;
+                bool has_work = m_queue_cv.wait_for(lock, m_options.idle_timeout, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+                --m_idle;
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                if(!has_work)
+                {
+                    if(m_workers.size() > m_options.min_threads)
+                    {
+                        // Retire: hand our own std::thread to whoever joins next.
+                        auto self = m_workers.find(id);
+                        m_finished.push_back(std::move(self->second));
+                        m_workers.erase(self);
+                        record_locked(false);
+                        return;
+                    }
+                    continue;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop_front();
+            }
+            task.run();
+        }
+    }
+};
+
+void print_metrics(const char* label, ElasticThreadPool& pool)
+{
+    auto m = pool.metrics();
+    LOG(label, ": size ", m.current_size, ", idle ", m.idle_workers, ", peak ", m.peak_size, ", grew ",
+        m.grow_events, "x, shrank ", m.shrink_events, "x, queued ", m.queue_depth);
+}
+
+int main(int argc, char** argv)
+{
+    using namespace std::chrono_literals;
+
+    ElasticThreadPool pool({1, 16, 5ms, 100ms});
+    print_metrics("start", pool);
+
+    // Burst: 400 tasks of 2ms each.
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> results;
+    for(int i=0; i<400; ++i)
+    {
+        results.push_back(pool.enqueue([](){ std::this_thread::sleep_for(2ms); }));
+    }
+    print_metrics("after burst enqueue", pool);
+    for(auto& result: results)
+    {
+        result.get();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    print_metrics("burst done", pool);
+    LOG("Burst took ", elapsed.count(), "ms (", 400 * 2, "ms of work)");
+
+    // Off-peak: idle workers retire after 100ms.
+    std::this_thread::sleep_for(400ms);
+    print_metrics("off-peak", pool);
+
+    auto m = pool.metrics();
+    for(const auto& event : m.recent_events)
+    {
+        LOG("  +", std::chrono::duration_cast<std::chrono::milliseconds>(event.when - start).count(), "ms ",
+            event.grew ? "grew to " : "shrank to ", event.new_size);
+    }
+    return 0;
+}
@@ -0,0 +1,386 @@
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <span>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * LEDGER ENGINE
+ * transfer_money in locking.cpp puts a mutex in every Account and locks both with std::lock. For
+ * millions of accounts that's a mutex (40 bytes) per account, and std::lock avoids deadlock by
+ * try_lock + back off, which gets expensive once two transfers want the same account.
+ *
+ * Ledger uses LOCK STRIPING instead:
+ *  1. Balances live in one flat array. A fixed number of mutexes (stripes) guard them, account a is
+ *     guarded by stripe (a & mask). Memory for locks no longer grows with the number of accounts.
+ *  2. Deadlock is avoided by ORDERED ACQUISITION: every operation locks the stripes it needs in
+ *     ascending stripe order. Two threads can then never hold one lock each and wait for the other's,
+ *     so plain lock() is enough, no try_lock/back off dance.
+ *  3. batch_transfer applies many transfers all-or-nothing: collect the stripes of every account
+ *     involved, sort, dedupe, lock them in order, check, apply. Same ordering rule, so batches are
+ *     deadlock free against each other and against single transfers.
+ *  4. total() locks ALL stripes in order, so it sees a consistent state, no transfer half applied.
+ *     This is the consistency checker: the total never changes, money only moves.
+ *
+ * Each stripe is padded to a cache line so neighbouring stripes don't false-share.
+ */
+
+struct Transfer
+{
+    size_t from;
+    size_t to;
+    std::int64_t amount;
+};
+
+class Ledger
+{
+public:
+    Ledger(size_t num_accounts, std::int64_t initial_balance, size_t stripes = 4096):
+        m_balances(num_accounts, initial_balance),
+        m_stripe_mask(std::bit_ceil(std::max<size_t>(stripes, 1)) - 1),
+        m_stripes(std::make_unique<Stripe[]>(m_stripe_mask + 1))
+    {}
+
+    size_t size() const { return m_balances.size(); }
+
+    /// Returns false (and changes nothing) if `from` can't cover the amount.
+    bool transfer(size_t from, size_t to, std::int64_t amount)
+    {
+        check(Transfer{from, to, amount});
+        size_t first = stripe_of(from);
+        size_t second = stripe_of(to);
+        if(first > second)
+        {
+            std::swap(first, second);
+        }
+
+        std::unique_lock lock1{m_stripes[first].mutex};
+        std::unique_lock<std::mutex> lock2;
+        if(second != first)
+        {
+            lock2 = std::unique_lock{m_stripes[second].mutex};
+        }
+
+        if(m_balances[from] < amount)
+        {
+            return false;
+        }
+        m_balances[from] -= amount;
+        m_balances[to] += amount;
+        return true;
+    }
+
+    /**
+     * All transfers are applied, or none (returns false) if any of them would overdraw an account.
+     * Transfers are applied in the given order, so a later one may spend money an earlier one moved in.
+     */
+    bool batch_transfer(std::span<const Transfer> transfers)
+    {
+        std::vector<size_t> stripes;
+        stripes.reserve(2 * transfers.size());
+        for(const auto& t : transfers)
+        {
+            check(t);
+            stripes.push_back(stripe_of(t.from));
+            stripes.push_back(stripe_of(t.to));
+        }
+        std::sort(stripes.begin(), stripes.end());
+        stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(stripes.size());
+        for(size_t stripe : stripes)
+        {
+            locks.emplace_back(m_stripes[stripe].mutex);
+        }
+
+        size_t applied = 0;
+        for(; applied<transfers.size(); ++applied)
+        {
+            const auto& t = transfers[applied];
+            if(m_balances[t.from] < t.amount)
+            {
+                break;
+            }
+            m_balances[t.from] -= t.amount;
+            m_balances[t.to] += t.amount;
+        }
+        if(applied == transfers.size())
+        {
+            return true;
+        }
+
+        // Roll back in reverse order, we still hold every lock involved.
+        while(applied > 0)
+        {
+            const auto& t = transfers[--applied];
+            m_balances[t.to] -= t.amount;
+            m_balances[t.from] += t.amount;
+        }
+        return false;
+    }
+
+    std::int64_t balance(size_t account)
+    {
+        std::lock_guard lock(m_stripes[stripe_of(account)].mutex);
+        return m_balances.at(account);
+    }
+
+    /// Consistent sum of all balances: every stripe is held while summing.
+    std::int64_t total()
+    {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(m_stripe_mask + 1);
+        for(size_t i=0; i<=m_stripe_mask; ++i)
+        {
+            locks.emplace_back(m_stripes[i].mutex);
+        }
+        std::int64_t sum = 0;
+        for(auto balance : m_balances)
+        {
+            sum += balance;
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(64) Stripe
+    {
+        std::mutex mutex;
+    };
+
+    std::vector<std::int64_t> m_balances;
+    size_t m_stripe_mask;
+    std::unique_ptr<Stripe[]> m_stripes;
+
+    size_t stripe_of(size_t account) const
+    {
+        return account & m_stripe_mask;
+    }
+
+    void check(const Transfer& t) const
+    {
+        if(t.from >= m_balances.size() || t.to >= m_balances.size())
+        {
+            throw std::out_of_range("Unknown account");
+        }
+        if(t.amount < 0)
+        {
+            throw std::invalid_argument("Negative transfer amount");
+        }
+    }
+};
+
+/**
+ * The locking.cpp design for comparison: a mutex per account and std::lock for every transfer.
+ */
+struct Account
+{
+    std::int64_t _balance {0};
+    std::mutex _mut;
+};
+
+class PerAccountLedger
+{
+public:
+    PerAccountLedger(size_t num_accounts, std::int64_t initial_balance):
+        m_accounts(num_accounts)
+    {
+        for(auto& account : m_accounts)
+        {
+            account._balance = initial_balance;
+        }
+    }
+
+    size_t size() const { return m_accounts.size(); }
+
+    bool transfer(size_t from, size_t to, std::int64_t amount)
+    {
+        if(from == to)
+        {
+            std::lock_guard lock(m_accounts[from]._mut);
+            return m_accounts[from]._balance >= amount;
+        }
+        std::unique_lock<std::mutex> lock1{m_accounts[from]._mut, std::defer_lock};
+        std::unique_lock<std::mutex> lock2{m_accounts[to]._mut, std::defer_lock};
+        std::lock(lock1, lock2);
+        if(m_accounts[from]._balance < amount)
+        {
+            return false;
+        }
+        m_accounts[from]._balance -= amount;
+        m_accounts[to]._balance += amount;
+        return true;
+    }
+
+    /// Only valid while nobody transfers, there's no lock covering all accounts at once.
+    std::int64_t total()
+    {
+        std::int64_t sum = 0;
+        for(auto& account : m_accounts)
+        {
+            sum += account._balance;
+        }
+        return sum;
+    }
+
+private:
+    std::vector<Account> m_accounts;
+};
+
+/**
+ * BENCHMARK: `num_threads` threads each do `per_thread` random transfers.
+ *   uniform: both accounts uniformly random.
+ *   hot:     90% of transfers touch one of 16 hot accounts (think exchange or payroll accounts).
+ * For Ledger a checker thread keeps calling total() while the transfers run.
+ */
+struct Workload
+{
+    size_t num_accounts;
+    bool hot;
+};
+
+Transfer random_transfer(std::mt19937_64& rng, const Workload& workload)
+{
+    constexpr size_t HOT_ACCOUNTS = 16;
+    std::uniform_int_distribution<size_t> any(0, workload.num_accounts - 1);
+    std::uniform_int_distribution<size_t> hot(0, HOT_ACCOUNTS - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<std::int64_t> amount(1, 50);
+
+    Transfer t{any(rng), any(rng), amount(rng)};
+    if(workload.hot && percent(rng) < 90)
+    {
+        (percent(rng) < 50 ? t.from : t.to) = hot(rng);
+    }
+    return t;
+}
+
+template <typename LedgerType>
+void benchmark(const char* label, LedgerType& ledger, const Workload& workload, size_t num_threads,
+               size_t per_thread, bool check_concurrently)
+{
+    const std::int64_t expected = ledger.total();
+    std::atomic<bool> running{true};
+    std::atomic<size_t> checks{0};
+    std::atomic<size_t> inconsistent{0};
+
+    std::thread checker;
+    if constexpr(std::is_same_v<LedgerType, Ledger>)
+    {
+        if(check_concurrently)
+        {
+            checker = std::thread{[&](){
+                while(running)
+                {
+                    if(ledger.total() != expected)
+                    {
+                        ++inconsistent;
+                    }
+                    ++checks;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            }};
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<num_threads; ++t)
+    {
+        threads.emplace_back([&ledger, &workload, per_thread, t](){
+            std::mt19937_64 rng{t + 1};
+            for(size_t i=0; i<per_thread; ++i)
+            {
+                auto transfer = random_transfer(rng, workload);
+                ledger.transfer(transfer.from, transfer.to, transfer.amount);
+            }
+        });
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    running = false;
+    if(checker.joinable())
+    {
+        checker.join();
+    }
+
+    bool consistent = ledger.total() == expected && inconsistent == 0;
+    LOG(label, " ", workload.hot ? "hot    " : "uniform", " threads ", num_threads, ": ",
+        num_threads * per_thread / elapsed.count() / 1e6, " M transfers/s",
+        checks > 0 ? ", " + std::to_string(checks.load()) + " live checks" : std::string{},
+        consistent ? ", total OK" : ", TOTAL CHANGED");
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t num_accounts = 1000000;
+    constexpr std::int64_t initial = 1000;
+    constexpr size_t per_thread = 200000;
+
+    Ledger ledger(num_accounts, initial);
+    PerAccountLedger per_account(num_accounts, initial);
+
+    for(bool hot : {false, true})
+    {
+        Workload workload{num_accounts, hot};
+        for(size_t num_threads : {1, 2, 4, 8})
+        {
+            benchmark("per-account std::lock", per_account, workload, num_threads, per_thread, false);
+            benchmark("striped ordered      ", ledger, workload, num_threads, per_thread, true);
+        }
+    }
+
+    // Batches: all-or-nothing, deadlock free even when batches overlap in opposite orders.
+    std::vector<std::thread> threads;
+    std::atomic<size_t> committed{0};
+    for(size_t t=0; t<4; ++t)
+    {
+        threads.emplace_back([&ledger, &committed, t](){
+            std::mt19937_64 rng{100 + t};
+            Workload workload{ledger.size(), true};
+            std::vector<Transfer> batch(32);
+            for(int i=0; i<2000; ++i)
+            {
+                for(auto& transfer : batch)
+                {
+                    transfer = random_transfer(rng, workload);
+                }
+                committed += ledger.batch_transfer(batch);
+            }
+        });
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+    LOG("Batches committed ", committed.load(), " of 8000, total ",
+        ledger.total() == static_cast<std::int64_t>(num_accounts) * initial ? "OK" : "CHANGED");
+
+    // A batch that can't be covered is rolled back completely.
+    std::int64_t before = ledger.balance(7);
+    std::vector<Transfer> overdraw{{7, 8, 1}, {7, 9, before + 1}};
+    bool ok = ledger.batch_transfer(overdraw);
+    LOG("Overdrawing batch ", ok ? "applied (WRONG)" : "rejected", ", balance of 7 unchanged: ",
+        ledger.balance(7) == before ? "yes" : "no");
+    return 0;
+}
@@ -0,0 +1,402 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <semaphore>
+#include <optional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * LOCK-FREE BOUNDED BUFFERS
+ * BoundedBuffer in bounded_buffer.cpp pays for one mutex lock and two semaphore operations on every
+ * push and pop. Two variants without any lock:
+ *
+ *  1. SpscBoundedBuffer: exactly one producer thread and one consumer thread.
+ *     The producer is the only writer of m_head and the consumer the only writer of m_tail, so a
+ *     plain load/store pair with acquire/release is enough, no compare_exchange. try_push and
+ *     try_pop finish in a bounded number of steps: wait-free.
+ *     head and tail live on their own cache lines, otherwise every push would invalidate the
+ *     consumer's cache line and vice versa (false sharing). Each side also keeps a cached copy of
+ *     the other side's index and only re-reads the shared one when the cache says full/empty.
+ *
+ *  2. MpmcBoundedBuffer: any number of producers and consumers (same cell/sequence scheme as the
+ *     task ring in lock_free_thread_pool.cpp):
+ *      sequence == pos       -> cell is free, a producer may claim it.
+ *      sequence == pos + 1   -> cell holds data, a consumer may claim it.
+ *     Producers race on m_enqueue_pos, consumers on m_dequeue_pos, the winner owns the cell.
+ *
+ * Both keep the blocking push()/pop() of the original. Without semaphores a blocked side spins for
+ * a bit and then yields; the try_* functions are there for callers that have something better to do.
+ */
+
+constexpr size_t CACHE_LINE = 64;
+
+/// The original class, unchanged, as the benchmark baseline.
+template <typename T, size_t N>
+class BoundedBuffer
+{
+public:
+    void push(const T& data)
+    {
+        do_push(data);
+    }
+    void push(T&& data)
+    {
+        do_push(std::forward<T>(data));
+    }
+
+    T pop()
+    {
+        m_data_full.acquire();
+        // Delayed initialization using std::optional.
+        std::optional<T> data;
+        try{
+            std::unique_lock lock(m_data_mutex);
+            data = std::move(m_data[m_read_pos]);
+            m_read_pos = (m_read_pos + 1) % N;
+        }
+        catch(...){
+            m_data_full.release();
+            throw;
+        }
+        m_data_empty.release();
+        return std::move(*data);
+    }
+
+private:
+    std::array<T, N> m_data;
+    std::mutex m_data_mutex;
+    size_t m_write_pos{0};
+    size_t m_read_pos{0};
+
+    std::counting_semaphore<N> m_data_full{0};
+    std::counting_semaphore<N> m_data_empty{N};
+
+    void do_push(auto&& data)
+    {
+        m_data_empty.acquire();
+        try{
+            std::unique_lock lock(m_data_mutex);
+            m_data[m_write_pos] = std::forward<decltype(data)>(data);
+            m_write_pos = (m_write_pos + 1) % N;
+        }
+        catch(...)
+        {
+            m_data_empty.release();
+            throw;
+        }
+        m_data_full.release();
+    }
+};
+
+/// Spin a few rounds with a CPU pause, then give the core away.
+class Backoff
+{
+public:
+    void pause()
+    {
+        if(m_spins < 64)
+        {
+            ++m_spins;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    int m_spins{0};
+};
+
+template <typename T, size_t N>
+class SpscBoundedBuffer
+{
+public:
+    /// Producer thread only.
+    bool try_push(const T& data)
+    {
+        return do_try_push(data);
+    }
+    bool try_push(T&& data)
+    {
+        return do_try_push(std::move(data));
+    }
+
+    /// Consumer thread only.
+    std::optional<T> try_pop()
+    {
+        size_t tail = m_consumer.index.load(std::memory_order_relaxed);
+        if(tail == m_consumer.cached_other)
+        {
+            m_consumer.cached_other = m_producer.index.load(std::memory_order_acquire);
+            if(tail == m_consumer.cached_other)
+            {
+                return std::nullopt; // empty
+            }
+        }
+        std::optional<T> data{std::move(m_data[tail % N])};
+        // Release: the producer may only reuse the slot after the move above.
+        m_consumer.index.store(tail + 1, std::memory_order_release);
+        return data;
+    }
+
+    void push(const T& data)
+    {
+        Backoff backoff;
+        while(!try_push(data))
+        {
+            backoff.pause();
+        }
+    }
+    void push(T&& data)
+    {
+        Backoff backoff;
+        while(!try_push(std::move(data)))
+        {
+            backoff.pause();
+        }
+    }
+
+    T pop()
+    {
+        Backoff backoff;
+        while(true)
+        {
+            if(auto data = try_pop())
+            {
+                return std::move(*data);
+            }
+            backoff.pause();
+        }
+    }
+
+private:
+    /// One cache line per side: the index that side writes plus its private copy of the other index.
+    struct alignas(CACHE_LINE) Side
+    {
+        std::atomic<size_t> index{0};
+        size_t cached_other{0};
+    };
+
+    Side m_producer; // index = head, next slot to write
+    Side m_consumer; // index = tail, next slot to read
+    std::array<T, N> m_data;
+
+    bool do_try_push(auto&& data)
+    {
+        size_t head = m_producer.index.load(std::memory_order_relaxed);
+        if(head - m_producer.cached_other == N)
+        {
+            m_producer.cached_other = m_consumer.index.load(std::memory_order_acquire);
+            if(head - m_producer.cached_other == N)
+            {
+                return false; // full
+            }
+        }
+        m_data[head % N] = std::forward<decltype(data)>(data);
+        // Release: the consumer sees the element before it sees the new head.
+        m_producer.index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+template <typename T, size_t N>
+class MpmcBoundedBuffer
+{
+public:
+    MpmcBoundedBuffer()
+    {
+        for(size_t i=0; i<N; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcBoundedBuffer(const MpmcBoundedBuffer&) = delete;
+    MpmcBoundedBuffer& operator=(const MpmcBoundedBuffer&) = delete;
+
+    bool try_push(const T& data)
+    {
+        return do_try_push(data);
+    }
+    bool try_push(T&& data)
+    {
+        return do_try_push(std::move(data));
+    }
+
+    std::optional<T> try_pop()
+    {
+        Cell* cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            cell = &m_cells[pos % N];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if(diff == 0)
+            {
+                if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(diff < 0)
+            {
+                return std::nullopt; // empty
+            }
+            else
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        std::optional<T> data{std::move(cell->data)};
+        // The cell is free again one lap later.
+        cell->sequence.store(pos + N, std::memory_order_release);
+        return data;
+    }
+
+    void push(const T& data)
+    {
+        Backoff backoff;
+        while(!try_push(data))
+        {
+            backoff.pause();
+        }
+    }
+    void push(T&& data)
+    {
+        Backoff backoff;
+        while(!try_push(std::move(data)))
+        {
+            backoff.pause();
+        }
+    }
+
+    T pop()
+    {
+        Backoff backoff;
+        while(true)
+        {
+            if(auto data = try_pop())
+            {
+                return std::move(*data);
+            }
+            backoff.pause();
+        }
+    }
+
+private:
+    struct alignas(CACHE_LINE) Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::array<Cell, N> m_cells;
+    alignas(CACHE_LINE) std::atomic<size_t> m_enqueue_pos{0};
+    alignas(CACHE_LINE) std::atomic<size_t> m_dequeue_pos{0};
+
+    bool do_try_push(auto&& data)
+    {
+        Cell* cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            cell = &m_cells[pos % N];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if(diff == 0)
+            {
+                if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::forward<decltype(data)>(data);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * BENCHMARK: `pairs` producers and `pairs` consumers move `per_producer` ints each through a
+ * 1024 slot buffer. Reported per core actually available, since oversubscribed threads only
+ * share the same cores.
+ */
+template <typename Buffer>
+void benchmark(const char* label, size_t pairs, size_t per_producer)
+{
+    auto buffer = std::make_unique<Buffer>();
+    std::atomic<long long> sum{0};
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t p=0; p<pairs; ++p)
+    {
+        threads.emplace_back([&buffer, per_producer](){
+            for(size_t i=0; i<per_producer; ++i)
+            {
+                buffer->push(static_cast<int>(i));
+            }
+        });
+        threads.emplace_back([&buffer, &sum, per_producer](){
+            long long local = 0;
+            for(size_t i=0; i<per_producer; ++i)
+            {
+                local += buffer->pop();
+            }
+            sum += local;
+        });
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    long long expected = static_cast<long long>(pairs) * per_producer * (per_producer - 1) / 2;
+    size_t cores = std::min<size_t>(2 * pairs, std::max(1u, std::thread::hardware_concurrency()));
+    double mops = pairs * per_producer / elapsed.count() / 1e6;
+    LOG(label, " ", pairs, "P/", pairs, "C: ", mops, " Mops/s, ", mops / cores, " Mops/s per core",
+        sum == expected ? "" : "  WRONG SUM");
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t capacity = 1024;
+    constexpr size_t items = 1000000;
+
+    benchmark<BoundedBuffer<int, capacity>>("mutex+semaphores", 1, items);
+    benchmark<SpscBoundedBuffer<int, capacity>>("spsc            ", 1, items);
+    benchmark<MpmcBoundedBuffer<int, capacity>>("mpmc            ", 1, items);
+
+    for(size_t pairs : {2, 4})
+    {
+        benchmark<BoundedBuffer<int, capacity>>("mutex+semaphores", pairs, items / pairs);
+        benchmark<MpmcBoundedBuffer<int, capacity>>("mpmc            ", pairs, items / pairs);
+    }
+    return 0;
+}
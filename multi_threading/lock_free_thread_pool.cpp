@@ -0,0 +1,402 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <latch>
+#include <memory>
+#include <cstdint>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * LOCK-FREE TASK STORE
+ * In thread_pool.cpp every enqueue() takes m_queue_mutex and calls notify_one(), and every worker
+ * wakeup takes the same mutex. Producers and consumers all serialize on it.
+ *
+ * Here the task store is a bounded multi-producer/multi-consumer ring (Dmitry Vyukov's design):
+ *  1. Each cell has a sequence number. For a cell at position pos:
+ *      sequence == pos       -> cell is free, a producer may claim it.
+ *      sequence == pos + 1   -> cell holds data, a consumer may claim it.
+ *  2. Producers race on m_enqueue_pos with compare_exchange, consumers race on m_dequeue_pos.
+ *     Whoever wins owns the cell, writes/reads it, and publishes with a release store on sequence.
+ *  3. Nobody ever holds a lock, so a preempted thread can not block the others.
+ *
+ * Parking: a worker that finds the ring empty spins for a while and then sleeps on
+ * std::atomic::wait (a futex on Linux). Producers only touch the futex when someone is asleep.
+ */
+
+constexpr size_t CACHE_LINE = 64;
+
+template <typename T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity)
+    {
+        // Round up to a power of two so that "% capacity" becomes "& mask".
+        size_t size = 2;
+        while(size < capacity)
+        {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_cells = std::make_unique<Cell[]>(size);
+        for(size_t i=0; i<size; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool try_push(T&& data)
+    {
+        Cell* cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if(diff == 0)
+            {
+                if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false; // Full: the consumer has not released this cell from the last lap yet.
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(data);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& data)
+    {
+        Cell* cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if(diff == 0)
+            {
+                if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false; // Empty.
+            }
+            else
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        data = std::move(cell->data);
+        // Mark the cell free for the producer one lap ahead.
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    /// NOTE: Each cell on its own cache line so neighbouring producers/consumers don't false-share.
+    struct alignas(CACHE_LINE) Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    alignas(CACHE_LINE) std::atomic<size_t> m_enqueue_pos{0};
+    alignas(CACHE_LINE) std::atomic<size_t> m_dequeue_pos{0};
+};
+
+/// The original mutex + condition_variable design from thread_pool.cpp, kept for the benchmark.
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push([task]() { (*task)(); });
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+/**
+ * Same enqueue() API as ThreadPool, but tasks live in an MpmcQueue.
+ * NOTE: The ring is bounded. When it is full enqueue() yields until a worker frees a slot, so
+ * don't fill it from inside the pool's own tasks or all workers can end up waiting on each other.
+ */
+class LockFreeThreadPool
+{
+public:
+    LockFreeThreadPool(size_t num_threads = std::thread::hardware_concurrency(),
+                       size_t queue_capacity = 1 << 16,
+                       size_t spin_count = 2000):
+        m_queue(queue_capacity),
+        m_spin_count(spin_count)
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~LockFreeThreadPool()
+    {
+        m_stop_flag = true;
+        m_wake_epoch.fetch_add(1);
+        m_wake_epoch.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        if(m_stop_flag)
+        {
+            throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+        }
+
+        std::function<void()> wrapper = [task]() { (*task)(); };
+        while(!m_queue.try_push(std::move(wrapper)))
+        {
+            std::this_thread::yield(); // Full: back off, never block on a mutex.
+        }
+
+        /// NOTE: Pairs with the fence in worker(). Either we see the sleeper, or the sleeper sees
+        /// our task on its last try_pop before it goes to sleep.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_sleepers.load(std::memory_order_relaxed) > 0)
+        {
+            m_wake_epoch.fetch_add(1, std::memory_order_release);
+            m_wake_epoch.notify_one();
+        }
+        return result;
+    }
+
+    size_t capacity() const
+    {
+        return m_queue.capacity();
+    }
+
+private:
+    MpmcQueue<std::function<void()>> m_queue;
+    std::vector<std::thread> m_workers;
+    size_t m_spin_count;
+    alignas(CACHE_LINE) std::atomic<uint32_t> m_wake_epoch{0};
+    alignas(CACHE_LINE) std::atomic<size_t> m_sleepers{0};
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        std::function<void()> task;
+        while(true)
+        {
+            bool found = false;
+            for(size_t i=0; i<m_spin_count && !found; ++i)
+            {
+                found = m_queue.try_pop(task);
+            }
+
+            if(!found)
+            {
+                // Read the epoch BEFORE the last check, so a wake up in between is not lost.
+                uint32_t epoch = m_wake_epoch.load(std::memory_order_acquire);
+                m_sleepers.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                found = m_queue.try_pop(task);
+                if(!found)
+                {
+                    if(m_stop_flag)
+                    {
+                        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    m_wake_epoch.wait(epoch, std::memory_order_acquire);
+                }
+                m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            if(found)
+            {
+                task();
+                task = nullptr;
+            }
+        }
+    }
+};
+
+/**
+ * BENCHMARK: 8 producer threads hammer enqueue() with tiny tasks, workers drain them.
+ * With the mutex design producers and workers all queue up on m_queue_mutex.
+ */
+template <typename Pool>
+double contended_tasks_per_second(size_t num_workers, size_t num_producers, size_t tasks_per_producer)
+{
+    Pool pool(num_workers);
+    const size_t num_tasks = num_producers * tasks_per_producer;
+    std::latch done{static_cast<std::ptrdiff_t>(num_tasks)};
+    std::latch start_line{static_cast<std::ptrdiff_t>(num_producers + 1)};
+
+    std::vector<std::thread> producers;
+    for(size_t p=0; p<num_producers; ++p)
+    {
+        producers.emplace_back([&](){
+            start_line.arrive_and_wait();
+            for(size_t i=0; i<tasks_per_producer; ++i)
+            {
+                pool.enqueue([&done](){ done.count_down(); });
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    start_line.arrive_and_wait();
+    done.wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    for(auto& t: producers)
+    {
+        t.join();
+    }
+    return num_tasks / elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t num_producers = 8;
+    constexpr size_t tasks_per_producer = 25000;
+
+    LOG("HW threads: ", std::thread::hardware_concurrency(), ", producers: ", num_producers,
+        ", tasks: ", num_producers * tasks_per_producer);
+    LOG("workers | mutex+cv (tasks/s) | lock-free MPMC (tasks/s)");
+    for(size_t workers : {1, 2, 4, 8})
+    {
+        LOG(workers, " | ",
+            static_cast<size_t>(contended_tasks_per_second<ThreadPool>(workers, num_producers, tasks_per_producer)), " | ",
+            static_cast<size_t>(contended_tasks_per_second<LockFreeThreadPool>(workers, num_producers, tasks_per_producer)));
+    }
+
+    LockFreeThreadPool pool(4);
+    auto answer = pool.enqueue([](int a, int b){ return a + b; }, 40, 2);
+    LOG("40 + 2 = ", answer.get(), " (ring capacity ", pool.capacity(), ")");
+    return 0;
+}
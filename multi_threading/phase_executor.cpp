@@ -0,0 +1,357 @@
+#include <thread>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <barrier>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <chrono>
+#include <span>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <type_traits>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * BULK-SYNCHRONOUS PHASE EXECUTOR
+ * fork-join.cpp creates num_dice threads that loop on std::barrier::arrive_and_wait, with a completion
+ * callback checking whether every dice shows 6. That's the pattern of every iterative solver:
+ *
+ *    repeat: every thread works on its part (kernel) -> barrier -> one thread combines the partial
+ *            results (reduction) and decides whether to go on -> next phase
+ *
+ * PhaseExecutor makes it reusable:
+ *  1. A PERSISTENT team: threads are created once and sleep between run() calls, instead of being
+ *     created and joined for every computation.
+ *  2. run(max_phases, kernel, reduce): kernel(thread, phase) returns that thread's partial result, it
+ *     lands in a cache-line padded slot. reduce(partials, phase) runs in the barrier completion, on
+ *     exactly one thread while the others wait, and returns false to stop (converged).
+ *  3. SpinBarrier: at thousands of phases per second a phase is a few hundred microseconds or less,
+ *     and going to sleep in the kernel (futex) and waking up again costs a good part of that. Waiters
+ *     spin first and only block if the phase takes long. Blocking uses std::atomic::wait, and the last
+ *     thread only calls notify when someone actually went to sleep.
+ */
+
+/// Sense-reversing (generation counting) barrier, spin then block.
+template <typename Completion>
+class SpinBarrier
+{
+public:
+    SpinBarrier(size_t count, Completion completion, size_t spin_count):
+        m_count(count), m_completion(std::move(completion)), m_spin_count(spin_count)
+    {}
+
+    void arrive_and_wait()
+    {
+        uint32_t generation = m_generation.load(std::memory_order_acquire);
+        if(m_arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == m_count)
+        {
+            // Last one in: everybody else is waiting, so the completion runs alone.
+            m_completion();
+            m_arrived.store(0, std::memory_order_relaxed);
+            m_generation.store(generation + 1, std::memory_order_seq_cst);
+            if(m_sleepers.load(std::memory_order_seq_cst) > 0)
+            {
+                m_generation.notify_all();
+            }
+            return;
+        }
+
+        for(size_t i=0; i<m_spin_count; ++i)
+        {
+            if(m_generation.load(std::memory_order_acquire) != generation)
+            {
+                return;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        // Sleeper count first, then re-check: the last thread stores the generation first, then
+        // checks for sleepers, so one of the two always sees the other (both seq_cst).
+        m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+        while(m_generation.load(std::memory_order_seq_cst) == generation)
+        {
+            m_generation.wait(generation, std::memory_order_acquire);
+        }
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+private:
+    const size_t m_count;
+    Completion m_completion;
+    const size_t m_spin_count;
+    alignas(64) std::atomic<size_t> m_arrived{0};
+    alignas(64) std::atomic<uint32_t> m_generation{0};
+    std::atomic<size_t> m_sleepers{0};
+};
+
+/// Spinning only helps when the thread we wait for runs on another core at the same time.
+size_t default_spin_count()
+{
+    return std::thread::hardware_concurrency() > 1 ? 4000 : 0;
+}
+
+class PhaseExecutor
+{
+public:
+    explicit PhaseExecutor(size_t num_threads = std::thread::hardware_concurrency(),
+                           size_t spin_count = default_spin_count()):
+        m_spin_count(spin_count)
+    {
+        num_threads = std::max<size_t>(num_threads, 1);
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_team.emplace_back([this, i](){ team_member(i); });
+        }
+    }
+
+    ~PhaseExecutor()
+    {
+        m_stop.store(true, std::memory_order_relaxed);
+        m_job_generation.fetch_add(1, std::memory_order_release);
+        m_job_generation.notify_all();
+        for(auto& thread : m_team)
+        {
+            thread.join();
+        }
+    }
+
+    size_t size() const { return m_team.size(); }
+
+    /**
+     * Runs phases until reduce returns false or max_phases is reached, returns the number of phases.
+     *   kernel(size_t thread, size_t phase) -> Partial
+     *   reduce(std::span<const Partial> partials, size_t phase) -> bool   (false: stop)
+     * One run at a time. An exception in a kernel or reduce stops the run and is rethrown here.
+     */
+    template <typename Kernel, typename Reduce>
+    size_t run(size_t max_phases, Kernel kernel, Reduce reduce)
+    {
+        using Partial = std::invoke_result_t<Kernel&, size_t, size_t>;
+        if(max_phases == 0)
+        {
+            return 0;
+        }
+
+        std::vector<Padded<Partial>> slots(size());
+        // Not a vector: vector<bool> has no contiguous storage to span over.
+        auto partials = std::make_unique<Partial[]>(size());
+        size_t phase = 0;
+        bool keep_going = true;
+        std::exception_ptr error;
+
+        auto completion = [&]() noexcept {
+            if(!error)
+            {
+                try
+                {
+                    for(size_t i=0; i<slots.size(); ++i)
+                    {
+                        partials[i] = slots[i].value;
+                    }
+                    keep_going = reduce(std::span<const Partial>{partials.get(), slots.size()}, phase);
+                }
+                catch(...)
+                {
+                    error = std::current_exception();
+                }
+            }
+            ++phase;
+            keep_going = keep_going && !error && phase < max_phases;
+        };
+        SpinBarrier barrier{size(), completion, m_spin_count};
+
+        // Every team member runs this. keep_going/phase are only written in the completion, and the
+        // barrier orders that write before anybody leaves arrive_and_wait.
+        m_job = [&](size_t thread) {
+            while(true)
+            {
+                try
+                {
+                    slots[thread].value = kernel(thread, phase);
+                }
+                catch(...)
+                {
+                    std::lock_guard lock(m_error_mutex);
+                    if(!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+                barrier.arrive_and_wait();
+                if(!keep_going)
+                {
+                    return;
+                }
+            }
+        };
+
+        m_remaining.store(size(), std::memory_order_relaxed);
+        m_job_generation.fetch_add(1, std::memory_order_release);
+        m_job_generation.notify_all();
+        while(size_t left = m_remaining.load(std::memory_order_acquire))
+        {
+            m_remaining.wait(left, std::memory_order_acquire);
+        }
+        m_job = nullptr;
+
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+        return phase;
+    }
+
+private:
+    template <typename T>
+    struct alignas(64) Padded
+    {
+        T value{};
+    };
+
+    std::vector<std::thread> m_team;
+    const size_t m_spin_count;
+    std::function<void(size_t)> m_job;
+    std::mutex m_error_mutex;
+    std::atomic<uint32_t> m_job_generation{0};
+    std::atomic<size_t> m_remaining{0};
+    std::atomic<bool> m_stop{false};
+
+    void team_member(size_t index)
+    {
+        uint32_t seen = 0;
+        while(true)
+        {
+            // Idle between runs: sleep until the job generation changes.
+            m_job_generation.wait(seen, std::memory_order_acquire);
+            seen = m_job_generation.load(std::memory_order_acquire);
+            if(m_stop.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+
+            m_job(index);
+            if(m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                m_remaining.notify_all();
+            }
+        }
+    }
+};
+
+/**
+ * BENCHMARK 1: barrier cost. Empty kernel, count phases per second.
+ * Baseline: a team of threads on std::barrier with a completion, as in fork-join.cpp.
+ */
+double std_barrier_phases_per_second(size_t num_threads, size_t phases)
+{
+    size_t phase = 0;
+    bool done = false;
+    auto checker = [&]() noexcept {
+        ++phase;
+        done = phase >= phases;
+    };
+    std::barrier bar{static_cast<std::ptrdiff_t>(num_threads), checker};
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t i=0; i<num_threads; ++i)
+    {
+        threads.emplace_back([&](){
+            while(!done)
+            {
+                bar.arrive_and_wait();
+            }
+        });
+    }
+    for(auto& t: threads)
+    {
+        t.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return phases / elapsed.count();
+}
+
+double executor_phases_per_second(PhaseExecutor& executor, size_t phases)
+{
+    auto start = std::chrono::steady_clock::now();
+    executor.run(phases, [](size_t, size_t) { return 0; }, [](std::span<const int>, size_t) { return true; });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return phases / elapsed.count();
+}
+
+/**
+ * BENCHMARK 2: a real solver. 1D heat equation with fixed ends, Jacobi iteration until the largest
+ * change in a phase drops below a tolerance. Each thread owns a contiguous block of cells,
+ * the reduction is the max over the threads' partial max deltas.
+ */
+void heat_equation(PhaseExecutor& executor, size_t cells)
+{
+    std::vector<double> current(cells, 0.0);
+    std::vector<double> next(cells, 0.0);
+    current.front() = next.front() = 100.0;
+    current.back() = next.back() = 0.0;
+
+    const size_t threads = executor.size();
+    const size_t block = (cells + threads - 1) / threads;
+    double* read = current.data();
+    double* write = next.data();
+
+    auto start = std::chrono::steady_clock::now();
+    size_t phases = executor.run(1000000,
+        [&](size_t thread, size_t) {
+            size_t begin = std::max<size_t>(1, thread * block);
+            size_t end = std::min(cells - 1, (thread + 1) * block);
+            double max_delta = 0.0;
+            for(size_t i=begin; i<end; ++i)
+            {
+                write[i] = 0.5 * (read[i - 1] + read[i + 1]);
+                max_delta = std::max(max_delta, std::abs(write[i] - read[i]));
+            }
+            return max_delta;
+        },
+        [&](std::span<const double> partials, size_t) {
+            std::swap(read, write);
+            return *std::max_element(partials.begin(), partials.end()) > 1e-4;
+        });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    LOG("Heat equation, ", cells, " cells: converged after ", phases, " phases, ",
+        phases / elapsed.count(), " phases/s, mid point ", read[cells / 2], " (exact 50)");
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t phases = 20000;
+    for(size_t num_threads : {2, 4, 8})
+    {
+        PhaseExecutor executor(num_threads);
+        LOG(num_threads, " threads: std::barrier team ", std_barrier_phases_per_second(num_threads, phases),
+            " phases/s, PhaseExecutor ", executor_phases_per_second(executor, phases), " phases/s");
+    }
+
+    PhaseExecutor executor(4);
+    heat_equation(executor, 64);
+
+    // The dice from fork-join.cpp on the same team: roll until all of them show 6.
+    std::vector<std::mt19937> engines;
+    for(size_t i=0; i<executor.size(); ++i)
+    {
+        engines.emplace_back(static_cast<unsigned>(i + 1));
+    }
+    size_t turns = executor.run(1000000,
+        [&engines](size_t thread, size_t) { return std::uniform_int_distribution<int>(1, 6)(engines[thread]); },
+        [](std::span<const int> dice, size_t) { return !std::all_of(dice.begin(), dice.end(), [](int d){ return d == 6; }); });
+    LOG("All ", executor.size(), " dice showed 6 after ", turns, " turns");
+    return 0;
+}
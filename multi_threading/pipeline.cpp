@@ -0,0 +1,473 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <type_traits>
+#include <exception>
+#include <stdexcept>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * PIPELINE OF BOUNDED BUFFERS
+ * bounded_buffer.cpp wires one producer to one consumer by hand. Here stages are chained:
+ *
+ *   input -> [buf] -> stage "parse" (1 thread) -> [buf] -> stage "score" (2 threads) -> ... -> sink
+ *
+ *  - Every arrow is a bounded buffer, so BACKPRESSURE is automatic: a slow stage fills its input
+ *    buffer, the stage before it blocks in push(), its own input fills up, and so on up to the
+ *    caller of Pipeline::push().
+ *  - Each stage has its own number of worker threads. With more than one, items can leave a stage
+ *    in a different order than they entered.
+ *  - End of stream: close() on the input buffer. A buffer that is closed and empty makes pop()
+ *    return nullopt; the last worker of a stage to see that closes the stage's output buffer.
+ *  - Errors: an exception from a stage function cancels the pipeline, like a failed task in the
+ *    pools. The first one is kept, every buffer is closed (push() returns false from then on, what
+ *    is queued drains) and wait() rethrows it.
+ *  - A builder dropped without sink() cancels its stages the same way, otherwise their threads
+ *    would wait for input forever and the destructor would never finish joining them.
+ *
+ * To find the bottleneck every stage counts items, time spent working (busy), time spent waiting for
+ * input (starved) and time spent waiting for space downstream (blocked), and its input buffer tracks
+ * occupancy. The bottleneck is the stage that is busy all the time while its input buffer sits full
+ * and the stages before it are blocked.
+ */
+
+/**
+ * BoundedBuffer plus close(). Semaphores can't be woken up "for good" at end of stream, so this one
+ * uses a mutex and two condition variables.
+ */
+template <typename T>
+class ClosableBuffer
+{
+public:
+    explicit ClosableBuffer(size_t capacity): m_capacity(capacity) {}
+
+    /// Returns false if the buffer was closed.
+    bool push(T data)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_not_full.wait(lock, [this](){ return m_closed || m_queue.size() < m_capacity; });
+            if(m_closed)
+            {
+                return false;
+            }
+            m_queue.push_back(std::move(data));
+        }
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /// nullopt once the buffer is closed and drained.
+    std::optional<T> pop()
+    {
+        std::optional<T> data;
+        {
+            std::unique_lock lock(m_mutex);
+            m_not_empty.wait(lock, [this](){ return m_closed || !m_queue.empty(); });
+            if(m_queue.empty())
+            {
+                return std::nullopt;
+            }
+            // Occupancy as seen by consumers, averaged later.
+            m_occupancy_sum += m_queue.size();
+            ++m_pops;
+            data = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_not_full.notify_one();
+        return data;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+    size_t size()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_queue.size();
+    }
+
+    double average_occupancy()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_pops == 0 ? 0.0 : static_cast<double>(m_occupancy_sum) / m_pops;
+    }
+
+private:
+    const size_t m_capacity;
+    std::deque<T> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    bool m_closed{false};
+    unsigned long long m_occupancy_sum{0};
+    unsigned long long m_pops{0};
+};
+
+struct StageStats
+{
+    std::string name;
+    size_t parallelism{0};
+    std::atomic<unsigned long long> items{0};
+    std::atomic<long long> busy_ns{0};
+    std::atomic<long long> starved_ns{0}; // waiting in pop() of the input buffer
+    std::atomic<long long> blocked_ns{0}; // waiting in push() of the output buffer = backpressure
+
+    // Type erased view of the input buffer, for reports.
+    std::function<size_t()> input_size;
+    std::function<double()> input_average;
+    size_t input_capacity{0};
+};
+
+/// Owns all threads and stats of one pipeline, shared by the builder and the handle.
+struct PipelineRuntime
+{
+    std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+    std::vector<std::unique_ptr<StageStats>> stages;
+    std::mutex mutex;
+    std::vector<std::function<void()>> closers; // one per buffer
+    std::exception_ptr error;
+    /// NOTE: Last member: the workers use the stats above and are joined first.
+    std::vector<std::jthread> threads;
+
+    void add_buffer(std::function<void()> close)
+    {
+        std::lock_guard lock(mutex);
+        closers.push_back(std::move(close));
+    }
+
+    /// Closes every buffer: stages drain what is queued and stop.
+    void cancel()
+    {
+        std::lock_guard lock(mutex);
+        for(auto& close : closers)
+        {
+            close();
+        }
+    }
+
+    void fail(std::exception_ptr stage_error)
+    {
+        {
+            std::lock_guard lock(mutex);
+            if(!error)
+            {
+                error = stage_error;
+            }
+        }
+        cancel();
+    }
+
+    void report()
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        LOG(std::left, std::setw(10), "stage", std::right, std::setw(5), "thr", std::setw(10), "items",
+            std::setw(12), "items/s", std::setw(8), "busy%", std::setw(10), "starved%", std::setw(10),
+            "blocked%", std::setw(16), "input now/avg");
+        for(const auto& stage : stages)
+        {
+            double thread_ns = elapsed.count() * 1e9 * stage->parallelism;
+            auto percent = [thread_ns](long long ns) { return thread_ns == 0 ? 0.0 : 100.0 * ns / thread_ns; };
+            LOG(std::left, std::setw(10), stage->name, std::right, std::setw(5), stage->parallelism,
+                std::setw(10), stage->items.load(), std::setw(12), std::fixed, std::setprecision(0),
+                stage->items / elapsed.count(), std::setw(8), std::setprecision(1), percent(stage->busy_ns),
+                std::setw(10), percent(stage->starved_ns), std::setw(10), percent(stage->blocked_ns),
+                std::setw(8), stage->input_size(), "/", stage->input_capacity, " ", stage->input_average(),
+                std::defaultfloat, std::setprecision(6));
+        }
+    }
+};
+
+/// What a running pipeline looks like to the code feeding it.
+template <typename In>
+class Pipeline
+{
+public:
+    Pipeline(std::shared_ptr<PipelineRuntime> runtime, std::shared_ptr<ClosableBuffer<In>> input):
+        m_runtime(std::move(runtime)), m_input(std::move(input))
+    {}
+
+    Pipeline(Pipeline&&) = default;
+
+    ~Pipeline()
+    {
+        if(m_runtime)
+        {
+            close();
+            join();
+        }
+    }
+
+    /// Blocks while the first stage is backed up.
+    bool push(In data)
+    {
+        return m_input->push(std::move(data));
+    }
+
+    /// No more input. Stages finish what is queued and shut down one after another.
+    void close()
+    {
+        m_input->close();
+    }
+
+    /// Waits for all stages to finish, rethrows the first exception a stage function threw.
+    void wait()
+    {
+        join();
+        std::lock_guard lock(m_runtime->mutex);
+        if(m_runtime->error)
+        {
+            std::rethrow_exception(m_runtime->error);
+        }
+    }
+
+    void report()
+    {
+        m_runtime->report();
+    }
+
+private:
+    std::shared_ptr<PipelineRuntime> m_runtime;
+    std::shared_ptr<ClosableBuffer<In>> m_input;
+
+    void join()
+    {
+        for(auto& thread : m_runtime->threads)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+};
+
+template <typename In, typename Out>
+class PipelineBuilder
+{
+public:
+    PipelineBuilder(std::shared_ptr<PipelineRuntime> runtime, std::shared_ptr<ClosableBuffer<In>> input,
+                    std::shared_ptr<ClosableBuffer<Out>> tail, size_t capacity):
+        m_runtime(std::move(runtime)), m_input(std::move(input)), m_tail(std::move(tail)), m_capacity(capacity)
+    {}
+
+    PipelineBuilder(PipelineBuilder&&) = default;
+    PipelineBuilder(const PipelineBuilder&) = delete;
+    PipelineBuilder& operator=(const PipelineBuilder&) = delete;
+    PipelineBuilder& operator=(PipelineBuilder&&) = delete;
+
+    ~PipelineBuilder()
+    {
+        // Nothing consumes m_tail and nobody can feed or close m_input anymore.
+        if(m_runtime && !m_extended)
+        {
+            m_runtime->cancel();
+        }
+    }
+
+    /// Appends a stage running `fn` on `parallelism` threads. Its workers start right away.
+    template <typename F>
+    auto stage(std::string name, size_t parallelism, F fn)
+    {
+        using Next = std::invoke_result_t<F&, Out>;
+        auto output = std::make_shared<ClosableBuffer<Next>>(m_capacity);
+        m_runtime->add_buffer([output](){ output->close(); });
+        start_stage(std::move(name), parallelism,
+                    [fn, output](Out item) mutable -> long long {
+                        auto result = fn(std::move(item));
+                        auto before_push = std::chrono::steady_clock::now();
+                        output->push(std::move(result));
+                        return (std::chrono::steady_clock::now() - before_push).count();
+                    },
+                    [output](){ output->close(); });
+        return PipelineBuilder<In, Next>{m_runtime, m_input, output, m_capacity};
+    }
+
+    /// Last stage, consumes items. Returns the handle used to feed the pipeline.
+    template <typename F>
+    Pipeline<In> sink(std::string name, size_t parallelism, F fn)
+    {
+        start_stage(std::move(name), parallelism,
+                    [fn](Out item) mutable -> long long { fn(std::move(item)); return 0; },
+                    [](){});
+        return Pipeline<In>{m_runtime, m_input};
+    }
+
+private:
+    std::shared_ptr<PipelineRuntime> m_runtime;
+    std::shared_ptr<ClosableBuffer<In>> m_input;
+    std::shared_ptr<ClosableBuffer<Out>> m_tail;
+    size_t m_capacity;
+    bool m_extended{false}; // stage() or sink() took over m_tail
+
+    template <typename Process, typename OnDone>
+    void start_stage(std::string name, size_t parallelism, Process process, OnDone on_done)
+    {
+        if(m_extended)
+        {
+            throw std::logic_error("Pipeline stage already has a consumer");
+        }
+        m_extended = true;
+        parallelism = std::max<size_t>(parallelism, 1);
+        auto stats = std::make_unique<StageStats>();
+        stats->name = std::move(name);
+        stats->parallelism = parallelism;
+        stats->input_size = [tail = m_tail](){ return tail->size(); };
+        stats->input_average = [tail = m_tail](){ return tail->average_occupancy(); };
+        stats->input_capacity = m_tail->capacity();
+        StageStats& stage_stats = *stats;
+        m_runtime->stages.push_back(std::move(stats));
+
+        // The last worker of this stage to run out of input closes the output buffer.
+        auto remaining = std::make_shared<std::atomic<size_t>>(parallelism);
+        for(size_t i=0; i<parallelism; ++i)
+        {
+            m_runtime->threads.emplace_back([input = m_tail, process, on_done, remaining, &stage_stats,
+                                             runtime = m_runtime.get()]() mutable {
+                using Clock = std::chrono::steady_clock;
+                while(true)
+                {
+                    auto before_pop = Clock::now();
+                    auto item = input->pop();
+                    auto after_pop = Clock::now();
+                    stage_stats.starved_ns += (after_pop - before_pop).count();
+                    if(!item)
+                    {
+                        break;
+                    }
+
+                    // process() returns how long this call was blocked on the output. It can't be read
+                    // off stage_stats.blocked_ns, the other workers of the stage add to that as well.
+                    long long blocked = 0;
+                    try
+                    {
+                        blocked = process(std::move(*item));
+                    }
+                    catch(...)
+                    {
+                        runtime->fail(std::current_exception());
+                        continue;
+                    }
+                    // busy = total time in process() minus the part spent blocked on the output.
+                    stage_stats.blocked_ns += blocked;
+                    stage_stats.busy_ns += (Clock::now() - after_pop).count() - blocked;
+                    ++stage_stats.items;
+                }
+                if(remaining->fetch_sub(1) == 1)
+                {
+                    on_done();
+                }
+            });
+        }
+    }
+};
+
+/// Starts a pipeline whose input items are of type In. `capacity` is the size of every buffer.
+template <typename In>
+PipelineBuilder<In, In> make_pipeline(size_t capacity)
+{
+    auto input = std::make_shared<ClosableBuffer<In>>(capacity);
+    auto runtime = std::make_shared<PipelineRuntime>();
+    runtime->add_buffer([input](){ input->close(); });
+    return PipelineBuilder<In, In>{runtime, input, input, capacity};
+}
+
+void spin_for(std::chrono::microseconds duration)
+{
+    auto until = std::chrono::steady_clock::now() + duration;
+    while(std::chrono::steady_clock::now() < until) {}
+}
+
+int main(int argc, char** argv)
+{
+    using namespace std::chrono_literals;
+
+    // "score" is deliberately the slow stage: 40us per item against 5us everywhere else.
+    std::atomic<long long> total{0};
+    auto pipeline = make_pipeline<int>(64)
+        .stage("parse", 1, [](int n) { spin_for(5us); return std::to_string(n); })
+        .stage("score", 2, [](std::string s) { spin_for(40us); return std::stoll(s) * 2; })
+        .stage("format", 1, [](long long n) { spin_for(5us); return n; })
+        .sink("sum", 1, [&total](long long n) { total += n; });
+
+    constexpr int items = 10000;
+    std::jthread reporter{[&pipeline](std::stop_token stoken) {
+        while(!stoken.stop_requested())
+        {
+            std::this_thread::sleep_for(100ms);
+            pipeline.report();
+        }
+    }};
+
+    for(int i=0; i<items; ++i)
+    {
+        pipeline.push(i);
+    }
+    pipeline.close();
+    pipeline.wait();
+    reporter.request_stop();
+    reporter.join();
+
+    LOG("Final:");
+    pipeline.report();
+    LOG("Sum ", total.load(), " expected ", 2LL * items * (items - 1) / 2);
+
+    // A stage that throws cancels the pipeline, wait() rethrows.
+    {
+        auto failing = make_pipeline<int>(16)
+            .stage("check", 2, [](int n) {
+                if(n == 500)
+                {
+                    throw std::runtime_error("bad item " + std::to_string(n));
+                }
+                return n;
+            })
+            .sink("drop", 1, [](int) {});
+        int accepted = 0;
+        while(accepted < items && failing.push(accepted))
+        {
+            ++accepted;
+        }
+        failing.close();
+        try
+        {
+            failing.wait();
+        }
+        catch(const std::exception& e)
+        {
+            LOG("Pipeline failed: ", e.what(), ", ", accepted, " items accepted before it was cancelled");
+        }
+    }
+
+    // Forgot sink(): the builder cancels its stages instead of hanging in the destructor.
+    {
+        auto unfinished = make_pipeline<int>(16).stage("orphan", 1, [](int n) { return n; });
+    }
+    LOG("Builder without sink() shut down");
+    return 0;
+}
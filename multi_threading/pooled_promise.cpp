@@ -0,0 +1,552 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <optional>
+#include <variant>
+#include <memory>
+#include <chrono>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdlib>
+#include <new>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * POOLED PROMISE / FUTURE
+ * Every std::promise heap allocates the shared state that it and its future point to. For the
+ * divide example in conditional_vars.cpp that's nothing, at hundreds of thousands per second it is a
+ * malloc + free each, often on different threads (which is the slow case for most allocators).
+ *
+ * PooledPromise<T> / PooledFuture<T> take their state from a THREAD-LOCAL pool instead:
+ *  1. Each thread owns a pool per T. Creating a promise pops the local free list, no lock, no atomic
+ *     RMW, no new once the pool is warm.
+ *  2. The state is reference counted (promise + future). Whichever side lets go last gives it back
+ *     to the pool of the thread that created it:
+ *      - on the owner thread: push on the local free list.
+ *      - on any other thread: push on the owner's "remote" list, a lock-free stack. The owner takes
+ *        the whole remote list in one exchange() when its local list runs dry. Only the owner ever
+ *        pops, so the usual ABA problem of lock-free stacks can't happen.
+ *  3. Waiting is std::atomic::wait on the ready flag, set_value stores + notifies. No mutex, no
+ *     condition_variable inside the state.
+ *  4. When a thread exits its pool can't be freed (states from it may still be in flight), so it is
+ *     parked on an orphan list and adopted by the next thread that needs a pool.
+ *
+ * Same SharedState idea as small_task_thread_pool.cpp, with the pool moved from one global mutex
+ * protected free list to per-thread lists.
+ */
+
+// Same counter idiom as optimization_notes, atomic since several threads allocate.
+std::atomic<size_t> heap_allocations{0};
+void* operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+template <typename T>
+class StatePool;
+
+template <typename T>
+struct PromiseState
+{
+    /// NOTE: optional<void> is not a thing, so void results store an empty monostate.
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    std::atomic<uint32_t> ready{0};
+    std::atomic<uint32_t> refs{0};
+    std::optional<Value> value;
+    std::exception_ptr error;
+    StatePool<T>* owner = nullptr;
+    PromiseState* next_free = nullptr;
+};
+
+template <typename T>
+class StatePool
+{
+public:
+    /// The calling thread's pool.
+    static StatePool& local()
+    {
+        thread_local Handle handle;
+        return *handle.pool;
+    }
+
+    PromiseState<T>* acquire()
+    {
+        if(!m_local_free)
+        {
+            // Everything other threads gave back, in one go.
+            m_local_free = m_remote_free.exchange(nullptr, std::memory_order_acquire);
+            if(!m_local_free)
+            {
+                grow();
+            }
+        }
+        PromiseState<T>* state = m_local_free;
+        m_local_free = state->next_free;
+        state->ready.store(0, std::memory_order_relaxed);
+        state->refs.store(2, std::memory_order_relaxed); // promise + future
+        return state;
+    }
+
+    /// Drops one reference, recycles the state when it was the last one. Any thread.
+    static void release(PromiseState<T>* state)
+    {
+        if(state->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+        state->value.reset();
+        state->error = nullptr;
+
+        StatePool* owner = state->owner;
+        // Not local(): a thread that only drops futures must not get (or adopt) a pool, and during
+        // thread exit its Handle may already be gone.
+        if(current() == owner)
+        {
+            state->next_free = owner->m_local_free;
+            owner->m_local_free = state;
+            return;
+        }
+        PromiseState<T>* head = owner->m_remote_free.load(std::memory_order_relaxed);
+        do
+        {
+            state->next_free = head;
+        } while(!owner->m_remote_free.compare_exchange_weak(head, state, std::memory_order_release,
+                                                            std::memory_order_relaxed));
+    }
+
+private:
+    static constexpr size_t SLAB_SIZE = 256;
+
+    PromiseState<T>* m_local_free = nullptr;              // owner thread only
+    std::atomic<PromiseState<T>*> m_remote_free{nullptr}; // pushed by anyone, taken by the owner
+    std::vector<std::unique_ptr<PromiseState<T>[]>> m_slabs;
+
+    /// The calling thread's pool if it has one, nullptr otherwise. Plain pointer: constant
+    /// initialized and never destroyed, so it is safe to read at any time, thread exit included.
+    static StatePool*& current()
+    {
+        thread_local StatePool* pool = nullptr;
+        return pool;
+    }
+
+    void grow()
+    {
+        auto slab = std::make_unique<PromiseState<T>[]>(SLAB_SIZE);
+        for(size_t i=0; i<SLAB_SIZE; ++i)
+        {
+            slab[i].owner = this;
+            slab[i].next_free = m_local_free;
+            m_local_free = &slab[i];
+        }
+        m_slabs.push_back(std::move(slab));
+    }
+
+    /// Adopts an orphaned pool on first use, orphans it again at thread exit. Pools are never freed.
+    struct Handle
+    {
+        StatePool* pool;
+
+        Handle()
+        {
+            std::lock_guard lock(orphans_mutex());
+            auto& orphans = orphan_list();
+            if(orphans.empty())
+            {
+                pool = new StatePool;
+            }
+            else
+            {
+                pool = orphans.back();
+                orphans.pop_back();
+            }
+            current() = pool;
+        }
+
+        ~Handle()
+        {
+            current() = nullptr;
+            std::lock_guard lock(orphans_mutex());
+            orphan_list().push_back(pool);
+        }
+    };
+
+    static std::mutex& orphans_mutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::vector<StatePool*>& orphan_list()
+    {
+        static std::vector<StatePool*> orphans;
+        return orphans;
+    }
+};
+
+/// Move-only, get() once, like std::future.
+template <typename T>
+class PooledFuture
+{
+public:
+    PooledFuture() = default;
+    explicit PooledFuture(PromiseState<T>* state): m_state(state) {}
+
+    PooledFuture(PooledFuture&& other) noexcept: m_state(std::exchange(other.m_state, nullptr)) {}
+    PooledFuture& operator=(PooledFuture&& other) noexcept
+    {
+        if(this != &other)
+        {
+            release();
+            m_state = std::exchange(other.m_state, nullptr);
+        }
+        return *this;
+    }
+
+    PooledFuture(const PooledFuture&) = delete;
+    PooledFuture& operator=(const PooledFuture&) = delete;
+
+    ~PooledFuture()
+    {
+        release();
+    }
+
+    bool valid() const
+    {
+        return m_state != nullptr;
+    }
+
+    bool is_ready() const
+    {
+        return m_state && m_state->ready.load(std::memory_order_acquire) != 0;
+    }
+
+    void wait() const
+    {
+        while(m_state->ready.load(std::memory_order_acquire) == 0)
+        {
+            m_state->ready.wait(0, std::memory_order_acquire);
+        }
+    }
+
+    T get()
+    {
+        if(!m_state)
+        {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        wait();
+        if(m_state->error)
+        {
+            auto error = m_state->error;
+            release();
+            std::rethrow_exception(error);
+        }
+        if constexpr(std::is_void_v<T>)
+        {
+            release();
+        }
+        else
+        {
+            T result = std::move(*m_state->value);
+            release();
+            return result;
+        }
+    }
+
+private:
+    PromiseState<T>* m_state = nullptr;
+
+    void release()
+    {
+        if(m_state)
+        {
+            StatePool<T>::release(m_state);
+            m_state = nullptr;
+        }
+    }
+};
+
+template <typename T>
+class PooledPromise
+{
+public:
+    PooledPromise(): m_state(StatePool<T>::local().acquire()) {}
+
+    PooledPromise(PooledPromise&& other) noexcept:
+        m_state(std::exchange(other.m_state, nullptr)), m_future_taken(other.m_future_taken)
+    {}
+    PooledPromise& operator=(PooledPromise&& other) noexcept
+    {
+        if(this != &other)
+        {
+            abandon();
+            m_state = std::exchange(other.m_state, nullptr);
+            m_future_taken = other.m_future_taken;
+        }
+        return *this;
+    }
+
+    PooledPromise(const PooledPromise&) = delete;
+    PooledPromise& operator=(const PooledPromise&) = delete;
+
+    /// Like std::promise: destroyed without a value -> the future throws broken_promise.
+    ~PooledPromise()
+    {
+        abandon();
+    }
+
+    PooledFuture<T> get_future()
+    {
+        if(!m_state)
+        {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if(m_future_taken)
+        {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        m_future_taken = true;
+        return PooledFuture<T>{m_state};
+    }
+
+    template <typename... V>
+    void set_value(V&&... value)
+    {
+        check_unsatisfied();
+        m_state->value.emplace(std::forward<V>(value)...);
+        make_ready();
+    }
+
+    void set_exception(std::exception_ptr error)
+    {
+        check_unsatisfied();
+        m_state->error = std::move(error);
+        make_ready();
+    }
+
+private:
+    PromiseState<T>* m_state = nullptr;
+    bool m_future_taken = false;
+
+    void check_unsatisfied()
+    {
+        if(!m_state)
+        {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if(m_state->ready.load(std::memory_order_relaxed))
+        {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+    }
+
+    void make_ready()
+    {
+        m_state->ready.store(1, std::memory_order_release);
+        m_state->ready.notify_all();
+    }
+
+    void abandon()
+    {
+        if(!m_state)
+        {
+            return;
+        }
+        if(!m_state->ready.load(std::memory_order_relaxed))
+        {
+            m_state->error = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+            make_ready();
+        }
+        if(!m_future_taken)
+        {
+            StatePool<T>::release(m_state); // the future's reference, nobody will pick it up
+        }
+        StatePool<T>::release(m_state);
+        m_state = nullptr;
+    }
+};
+
+/**
+ * EXAMPLE: divide from conditional_vars.cpp with a pooled promise.
+ */
+void divide(int a, int b, PooledPromise<float> p)
+{
+    if(b == 0)
+    {
+        auto e = std::runtime_error{"Divide by Zero Exception"};
+        p.set_exception(std::make_exception_ptr(e));
+    }
+    else
+    {
+        float div = static_cast<float>(a) / b;
+        p.set_value(div);
+    }
+}
+
+/**
+ * BENCHMARK 1: create, set, get on one thread. Pure cost of the pair.
+ */
+template <template <typename> class Promise>
+void round_trip(const char* label, size_t iterations)
+{
+    heap_allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for(size_t i=0; i<iterations; ++i)
+    {
+        Promise<int> promise;
+        auto future = promise.get_future();
+        promise.set_value(static_cast<int>(i));
+        sum += future.get();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    size_t allocations = heap_allocations;
+    LOG(label, " same thread:  ", elapsed.count() / iterations, " ns per round trip, ",
+        static_cast<double>(allocations) / iterations, " allocations each",
+        sum == static_cast<long long>(iterations * (iterations - 1) / 2) ? "" : "  WRONG SUM");
+}
+
+/**
+ * BENCHMARK 2: the divide pattern. Main creates promises, a worker thread fulfils them in batches,
+ * main collects the futures. States are freed on both threads, so the remote return path is used.
+ */
+template <template <typename> class Promise, template <typename> class Future>
+void cross_thread(const char* label, size_t iterations, size_t batch)
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Promise<int>> inbox;
+    bool done = false;
+
+    std::thread worker{[&](){
+        std::vector<Promise<int>> work;
+        while(true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [&](){ return done || !inbox.empty(); });
+                if(inbox.empty())
+                {
+                    return;
+                }
+                work.swap(inbox);
+            }
+            for(size_t i=0; i<work.size(); ++i)
+            {
+                work[i].set_value(static_cast<int>(i));
+            }
+            work.clear();
+        }
+    }};
+
+    std::vector<Promise<int>> outgoing;
+    std::vector<Future<int>> futures;
+    outgoing.reserve(batch);
+    futures.reserve(batch);
+
+    heap_allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for(size_t done_count=0; done_count<iterations; done_count+=batch)
+    {
+        for(size_t i=0; i<batch; ++i)
+        {
+            outgoing.emplace_back();
+            futures.push_back(outgoing.back().get_future());
+        }
+        {
+            std::lock_guard lock(mutex);
+            inbox.swap(outgoing);
+        }
+        cv.notify_one();
+        for(auto& future : futures)
+        {
+            sum += future.get();
+        }
+        futures.clear();
+        outgoing.clear();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    size_t allocations = heap_allocations;
+    {
+        std::lock_guard lock(mutex);
+        done = true;
+    }
+    cv.notify_one();
+    worker.join();
+
+    LOG(label, " cross thread: ", elapsed.count() / iterations, " ns per round trip, ",
+        static_cast<double>(allocations) / iterations, " allocations each",
+        sum == static_cast<long long>(iterations / batch * (batch * (batch - 1) / 2)) ? "" : "  WRONG SUM");
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t iterations = 1000000;
+
+    // Warm up the pools so slabs don't show up in the allocation count.
+    round_trip<PooledPromise>("warm-up      ", 1000);
+    cross_thread<PooledPromise, PooledFuture>("warm-up      ", 10000, 1000);
+
+    round_trip<std::promise>("std::promise ", iterations);
+    round_trip<PooledPromise>("PooledPromise", iterations);
+    cross_thread<std::promise, std::future>("std::promise ", iterations, 1000);
+    cross_thread<PooledPromise, PooledFuture>("PooledPromise", iterations, 1000);
+
+    // Value, exception and a broken promise through the same pool.
+    for(int b : {2, 0})
+    {
+        PooledPromise<float> p;
+        auto future = p.get_future();
+        std::jthread t{divide, 10, b, std::move(p)};
+        try
+        {
+            LOG("DIV Received ", future.get());
+        }
+        catch(const std::exception& e)
+        {
+            LOG("Caught ", e.what());
+        }
+    }
+    PooledFuture<void> orphan;
+    {
+        PooledPromise<void> p;
+        orphan = p.get_future();
+    }
+    try
+    {
+        orphan.get();
+    }
+    catch(const std::future_error& e)
+    {
+        LOG("Caught ", e.what());
+    }
+    return 0;
+}
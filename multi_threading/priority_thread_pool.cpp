@@ -0,0 +1,327 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <array>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
+#include <algorithm>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * PRIORITY LANES
+ * One FIFO per priority instead of one FIFO for everything. Workers always look at the head of every
+ * lane (the oldest task in it) and pick the most urgent one.
+ *
+ * Aging: strict priorities can starve Background forever. So the "effective" priority of a lane head
+ * improves by one level for every `aging_step` it has been waiting:
+ *      effective = lane - waited / aging_step
+ * With aging_step = 50ms a background task waits at most ~100ms before it competes with High.
+ *
+ * Deadlines: a task may carry a deadline. If the deadline already passed when a worker picks it, the
+ * task is NOT run and its future throws DeadlineExpired instead.
+ *
+ * Counters (per lane): current depth, enqueued/executed/expired totals and total/max wait time.
+ */
+
+enum class Priority : size_t
+{
+    High = 0,
+    Normal = 1,
+    Background = 2
+};
+constexpr size_t NUM_LANES = 3;
+
+const char* to_string(Priority priority)
+{
+    switch(priority)
+    {
+        case Priority::High: return "High";
+        case Priority::Normal: return "Normal";
+        case Priority::Background: return "Background";
+    }
+    return "?";
+}
+
+struct TaskOptions
+{
+    Priority priority{Priority::Normal};
+    std::optional<std::chrono::steady_clock::time_point> deadline{};
+};
+
+struct DeadlineExpired : std::runtime_error
+{
+    DeadlineExpired(): std::runtime_error("Task deadline expired before it could run") {}
+};
+
+struct LaneStats
+{
+    size_t depth{0};
+    size_t enqueued{0};
+    size_t executed{0};
+    size_t expired{0};
+    std::chrono::nanoseconds total_wait{0};
+    std::chrono::nanoseconds max_wait{0};
+
+    std::chrono::nanoseconds average_wait() const
+    {
+        size_t started = executed + expired;
+        if(started == 0)
+        {
+            return std::chrono::nanoseconds{0};
+        }
+        return std::chrono::nanoseconds{total_wait.count() / static_cast<long long>(started)};
+    }
+};
+
+class PriorityThreadPool
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    PriorityThreadPool(size_t num_threads = std::thread::hardware_concurrency(),
+                       Clock::duration aging_step = std::chrono::milliseconds(50)):
+        m_aging_step(aging_step)
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~PriorityThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    /// Same as ThreadPool::enqueue: Normal priority, no deadline.
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        return enqueue(TaskOptions{}, std::forward<F>(func), std::forward<Args>(args)...);
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(const TaskOptions& options, F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        /// NOTE: A promise instead of a packaged_task, because an expired task must be able to
+        /// report DeadlineExpired without running the function.
+        auto promise = std::make_shared<std::promise<ReturnType>>();
+        std::future<ReturnType> result = promise->get_future();
+        auto bound = std::bind(std::forward<F>(func), std::forward<Args>(args)...);
+
+        Task task;
+        task.enqueue_time = Clock::now();
+        task.deadline = options.deadline;
+        task.run = [promise, bound = std::move(bound)](bool expired) mutable {
+            if(expired)
+            {
+                promise->set_exception(std::make_exception_ptr(DeadlineExpired{}));
+                return;
+            }
+            try
+            {
+                if constexpr(std::is_void_v<ReturnType>)
+                {
+                    bound();
+                    promise->set_value();
+                }
+                else
+                {
+                    promise->set_value(bound());
+                }
+            }
+            catch(...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        };
+
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            auto& lane = m_lanes[static_cast<size_t>(options.priority)];
+            lane.tasks.push_back(std::move(task));
+            ++lane.stats.enqueued;
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+    LaneStats stats(Priority priority)
+    {
+        std::lock_guard lock(m_queue_mutex);
+        auto& lane = m_lanes[static_cast<size_t>(priority)];
+        LaneStats snapshot = lane.stats;
+        snapshot.depth = lane.tasks.size();
+        return snapshot;
+    }
+
+private:
+    struct Task
+    {
+        std::function<void(bool expired)> run;
+        Clock::time_point enqueue_time;
+        std::optional<Clock::time_point> deadline;
+    };
+
+    struct Lane
+    {
+        std::deque<Task> tasks;
+        LaneStats stats;
+    };
+
+    std::vector<std::thread> m_workers;
+    std::array<Lane, NUM_LANES> m_lanes;
+    Clock::duration m_aging_step;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    bool empty() const
+    {
+        return std::all_of(m_lanes.begin(), m_lanes.end(), [](const Lane& lane){ return lane.tasks.empty(); });
+    }
+
+    /// Called with m_queue_mutex held and at least one task queued.
+    size_t pick_lane(Clock::time_point now) const
+    {
+        size_t best = NUM_LANES;
+        long long best_priority = 0;
+        for(size_t i=0; i<NUM_LANES; ++i)
+        {
+            if(m_lanes[i].tasks.empty())
+            {
+                continue;
+            }
+            auto waited = now - m_lanes[i].tasks.front().enqueue_time;
+            long long effective = static_cast<long long>(i) - static_cast<long long>(waited / m_aging_step);
+            // Strictly smaller wins, so on a tie the naturally higher lane keeps going first.
+            if(best == NUM_LANES || effective < best_priority)
+            {
+                best = i;
+                best_priority = effective;
+            }
+        }
+        return best;
+    }
+
+    void worker()
+    {
+        while(true)
+        {
+            Task task;
+            bool expired = false;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !empty();
+                });
+
+                if(m_stop_flag && empty())
+                {
+                    return;
+                }
+
+                auto now = Clock::now();
+                auto& lane = m_lanes[pick_lane(now)];
+                task = std::move(lane.tasks.front());
+                lane.tasks.pop_front();
+
+                auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(now - task.enqueue_time);
+                lane.stats.total_wait += waited;
+                lane.stats.max_wait = std::max(lane.stats.max_wait, waited);
+                expired = task.deadline && *task.deadline < now;
+                ++(expired ? lane.stats.expired : lane.stats.executed);
+            }
+            task.run(expired);
+        }
+    }
+};
+
+void print_stats(PriorityThreadPool& pool)
+{
+    for(auto priority : {Priority::High, Priority::Normal, Priority::Background})
+    {
+        auto s = pool.stats(priority);
+        LOG(to_string(priority), ": depth ", s.depth, ", enqueued ", s.enqueued, ", executed ", s.executed,
+            ", expired ", s.expired, ", avg wait ", std::chrono::duration_cast<std::chrono::microseconds>(s.average_wait()).count(),
+            "us, max wait ", std::chrono::duration_cast<std::chrono::microseconds>(s.max_wait).count(), "us");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace std::chrono_literals;
+
+    // One worker makes the ordering easy to see.
+    PriorityThreadPool pool(1, 20ms);
+    auto busy = [](){ std::this_thread::sleep_for(2ms); };
+
+    // Batch work first, then latency sensitive requests arrive behind it.
+    std::vector<std::future<void>> results;
+    for(int i=0; i<50; ++i)
+    {
+        results.push_back(pool.enqueue({Priority::Background}, busy));
+    }
+    for(int i=0; i<50; ++i)
+    {
+        results.push_back(pool.enqueue(busy));
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto request = pool.enqueue({Priority::High}, [start](){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    });
+    LOG("High priority request started after ", request.get(), "ms with 100 tasks queued before it");
+
+    // This one is already late by the time the worker gets to it.
+    auto late = pool.enqueue({Priority::Background, std::chrono::steady_clock::now() + 1ms}, [](){ return 42; });
+    try
+    {
+        late.get();
+    }
+    catch(const DeadlineExpired& e)
+    {
+        LOG("Caught ", e.what());
+    }
+
+    for(auto& result: results)
+    {
+        result.get();
+    }
+    // Aging: Background tasks kept making progress while Normal tasks were queued.
+    print_stats(pool);
+    return 0;
+}
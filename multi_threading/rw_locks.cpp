@@ -0,0 +1,322 @@
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <string>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * READ-MOSTLY SHARED STATE
+ * locking.cpp guards shared_data and Account with std::mutex: readers exclude each other although
+ * they change nothing. std::shared_mutex lets readers in together, but every lock_shared() still
+ * writes one shared reader counter, so the cache line bounces between reader cores.
+ *
+ * 1. SeqLock<T> for small trivially copyable snapshots. Readers never write anything:
+ *      read:  s1 = seq; copy data; s2 = seq;  retry if s1 is odd or s1 != s2
+ *      write: ++seq (odd = writing); write data; ++seq (even again)
+ *    A reader that raced a writer notices and retries, so readers cost a couple of loads and writers
+ *    are never blocked by readers. Not for data with pointers: a torn copy is thrown away but a torn
+ *    pointer may already have been followed.
+ *    The data itself is kept in atomic words with relaxed access, the fences do the ordering; a plain
+ *    memcpy racing a writer would be a data race (UB) even though the result is discarded.
+ *
+ * 2. PerCoreRWLock: reader counts split over cache-line padded slots, a reader only touches its own.
+ *      lock_shared: ++my_slot; if a writer is active: --my_slot, wait for it, retry
+ *      lock:        writer = true; wait until every slot is 0
+ *    The reader increments its slot and then checks the writer flag, the writer sets the flag and then
+ *    checks the slots (both seq_cst): at least one of them sees the other, so they can't both go in.
+ *    Writers pay for scanning all slots, fine when writes are rare.
+ *    Slots are picked per thread (like ShardedCounter in sharded_counter.cpp) instead of by current
+ *    CPU: a thread can migrate between lock_shared and unlock_shared, its thread index can't.
+ */
+
+constexpr size_t CACHE_LINE = 64;
+
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock copies T byte-wise");
+
+public:
+    explicit SeqLock(const T& initial = T{})
+    {
+        store_words(initial);
+    }
+
+    T load() const
+    {
+        while(true)
+        {
+            std::uint64_t before = m_seq.load(std::memory_order_acquire);
+            if(before & 1)
+            {
+                std::this_thread::yield(); // writer in progress
+                continue;
+            }
+            T value = load_words();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(m_seq.load(std::memory_order_relaxed) == before)
+            {
+                return value;
+            }
+        }
+    }
+
+    void store(const T& value)
+    {
+        std::lock_guard lock(m_write_mutex); // writers among themselves
+        std::uint64_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store_words(value);
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /// Read-modify-write under the writer lock.
+    template <typename F>
+    void update(F&& fn)
+    {
+        std::lock_guard lock(m_write_mutex);
+        T value = load_words();
+        fn(value);
+        std::uint64_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store_words(value);
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    alignas(CACHE_LINE) std::atomic<std::uint64_t> m_seq{0};
+    std::array<std::atomic<std::uint64_t>, WORDS> m_words{};
+    std::mutex m_write_mutex;
+
+    T load_words() const
+    {
+        std::array<std::uint64_t, WORDS> raw;
+        for(size_t i=0; i<WORDS; ++i)
+        {
+            raw[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        T value;
+        std::memcpy(&value, raw.data(), sizeof(T));
+        return value;
+    }
+
+    void store_words(const T& value)
+    {
+        std::array<std::uint64_t, WORDS> raw{};
+        std::memcpy(raw.data(), &value, sizeof(T));
+        for(size_t i=0; i<WORDS; ++i)
+        {
+            m_words[i].store(raw[i], std::memory_order_relaxed);
+        }
+    }
+};
+
+/// Meets the SharedMutex requirements used by std::shared_lock / std::unique_lock.
+class PerCoreRWLock
+{
+public:
+    explicit PerCoreRWLock(size_t slots = 2 * std::max(1u, std::thread::hardware_concurrency())):
+        m_num_slots(std::max<size_t>(slots, 1)),
+        m_slots(std::make_unique<Slot[]>(m_num_slots))
+    {}
+
+    void lock_shared()
+    {
+        auto& readers = m_slots[thread_index() % m_num_slots].readers;
+        while(true)
+        {
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            if(!m_writer.load(std::memory_order_seq_cst))
+            {
+                return;
+            }
+            // A writer is in or about to be: step back and let it finish.
+            readers.fetch_sub(1, std::memory_order_release);
+            m_writer.wait(true, std::memory_order_acquire);
+        }
+    }
+
+    void unlock_shared()
+    {
+        m_slots[thread_index() % m_num_slots].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock()
+    {
+        m_write_mutex.lock(); // one writer at a time
+        m_writer.store(true, std::memory_order_seq_cst);
+        for(size_t i=0; i<m_num_slots; ++i)
+        {
+            while(m_slots[i].readers.load(std::memory_order_seq_cst) != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock()
+    {
+        m_writer.store(false, std::memory_order_release);
+        m_writer.notify_all();
+        m_write_mutex.unlock();
+    }
+
+private:
+    struct alignas(CACHE_LINE) Slot
+    {
+        std::atomic<int> readers{0};
+    };
+
+    size_t m_num_slots;
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(CACHE_LINE) std::atomic<bool> m_writer{false};
+    std::mutex m_write_mutex;
+
+    static size_t thread_index()
+    {
+        static std::atomic<size_t> next_index{0};
+        thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+};
+
+/**
+ * BENCHMARK: read-mostly account state. `num_readers` threads read the snapshot in a loop, one writer
+ * updates it every ~50us. Writers keep checking == -balance, so a reader that sees anything else saw
+ * a half written update.
+ */
+struct AccountSnapshot
+{
+    std::int64_t balance;
+    std::int64_t version;
+    std::int64_t check;
+};
+
+/// Same interface (read/write) over every protection scheme.
+template <typename Mutex>
+class Locked
+{
+public:
+    AccountSnapshot read()
+    {
+        std::shared_lock lock(m_mutex);
+        return m_value;
+    }
+    void write(std::int64_t delta)
+    {
+        std::unique_lock lock(m_mutex);
+        m_value.balance += delta;
+        m_value.version += 1;
+        m_value.check = -m_value.balance;
+    }
+
+private:
+    Mutex m_mutex;
+    AccountSnapshot m_value{1000, 0, -1000};
+};
+
+/// std::mutex has no lock_shared, readers lock it exclusively like locking.cpp does.
+template <>
+AccountSnapshot Locked<std::mutex>::read()
+{
+    std::lock_guard lock(m_mutex);
+    return m_value;
+}
+
+class Sequenced
+{
+public:
+    AccountSnapshot read()
+    {
+        return m_value.load();
+    }
+    void write(std::int64_t delta)
+    {
+        m_value.update([delta](AccountSnapshot& value){
+            value.balance += delta;
+            value.version += 1;
+            value.check = -value.balance;
+        });
+    }
+
+private:
+    SeqLock<AccountSnapshot> m_value{AccountSnapshot{1000, 0, -1000}};
+};
+
+template <typename Shared>
+void benchmark(const char* label, size_t num_readers)
+{
+    using namespace std::chrono_literals;
+    Shared shared;
+    std::atomic<bool> running{true};
+    std::atomic<std::uint64_t> reads{0};
+    std::atomic<std::uint64_t> torn{0};
+
+    std::vector<std::thread> readers;
+    for(size_t r=0; r<num_readers; ++r)
+    {
+        readers.emplace_back([&](){
+            std::uint64_t local_reads = 0;
+            std::uint64_t local_torn = 0;
+            while(running.load(std::memory_order_relaxed))
+            {
+                AccountSnapshot snapshot = shared.read();
+                local_torn += snapshot.check != -snapshot.balance;
+                ++local_reads;
+            }
+            reads += local_reads;
+            torn += local_torn;
+        });
+    }
+
+    std::uint64_t writes = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + 200ms;
+    while(std::chrono::steady_clock::now() < end)
+    {
+        shared.write(writes % 2 ? 1 : -1);
+        ++writes;
+        auto until = std::chrono::steady_clock::now() + 50us;
+        while(std::chrono::steady_clock::now() < until) {}
+    }
+    running = false;
+    for(auto& reader: readers)
+    {
+        reader.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    LOG(label, " readers ", num_readers, ": ", reads / elapsed.count() / 1e6, " M reads/s, ",
+        writes, " writes", torn ? ", TORN READS " + std::to_string(torn.load()) : std::string{});
+}
+
+int main(int argc, char** argv)
+{
+    for(size_t num_readers : {1, 2, 4, 8})
+    {
+        benchmark<Locked<std::mutex>>("std::mutex       ", num_readers);
+        benchmark<Locked<std::shared_mutex>>("std::shared_mutex", num_readers);
+        benchmark<Locked<PerCoreRWLock>>("PerCoreRWLock    ", num_readers);
+        benchmark<Sequenced>("SeqLock          ", num_readers);
+    }
+    return 0;
+}
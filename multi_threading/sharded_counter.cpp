@@ -0,0 +1,168 @@
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <bit>
+#include <algorithm>
+#include <cstdint>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * SHARDED COUNTER
+ * increment_data in locking.cpp takes shared_data_mutex for a loop of increments. Metrics counters
+ * usually take the lock (or do one atomic increment) per event instead, from many threads, and all of
+ * them fight over the same cache line: every increment has to pull the line exclusively into its own
+ * core. Past a few threads that's all the counter does.
+ *
+ * ShardedCounter gives every thread its own slot, each slot on its own cache line:
+ *  - add():  fetch_add(relaxed) on the calling thread's slot. No other core touches that line, so it
+ *            stays in the local cache. relaxed is enough, a counter orders nothing else.
+ *  - read(): sums all slots. Cost grows with the number of shards, fine since reads are rare.
+ *            Adds running concurrently may or may not be included, the sum is not a snapshot of
+ *            one instant, but nothing gets lost: once all adders are done read() is exact.
+ *
+ * Threads are numbered once (thread_local) and use slot (index & mask). With more threads than
+ * shards two threads share a slot, still correct because the slot is atomic, just slower.
+ */
+
+constexpr size_t CACHE_LINE = 64;
+
+class ShardedCounter
+{
+public:
+    explicit ShardedCounter(size_t shards = 2 * std::max(1u, std::thread::hardware_concurrency())):
+        m_mask(std::bit_ceil(std::max<size_t>(shards, 1)) - 1),
+        m_shards(std::make_unique<Shard[]>(m_mask + 1))
+    {}
+
+    void add(std::int64_t n = 1)
+    {
+        m_shards[thread_index() & m_mask].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::int64_t read() const
+    {
+        std::int64_t sum = 0;
+        for(size_t i=0; i<=m_mask; ++i)
+        {
+            sum += m_shards[i].value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(CACHE_LINE) Shard
+    {
+        std::atomic<std::int64_t> value{0};
+    };
+
+    size_t m_mask;
+    std::unique_ptr<Shard[]> m_shards;
+
+    static size_t thread_index()
+    {
+        static std::atomic<size_t> next_index{0};
+        thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+};
+
+/// The locking.cpp way, one lock per event.
+class MutexCounter
+{
+public:
+    void add(std::int64_t n = 1)
+    {
+        std::lock_guard lock(m_mutex);
+        m_value += n;
+    }
+
+    std::int64_t read()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_value;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::int64_t m_value{0};
+};
+
+/// One shared atomic. No lock, but every add still bounces the same cache line between cores.
+class AtomicCounter
+{
+public:
+    void add(std::int64_t n = 1)
+    {
+        m_value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::int64_t read() const
+    {
+        return m_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::int64_t> m_value{0};
+};
+
+/**
+ * BENCHMARK: `total` increments split over `num_threads` threads.
+ */
+template <typename Counter>
+double benchmark(size_t num_threads, size_t total)
+{
+    Counter counter;
+    size_t per_thread = total / num_threads;
+    std::atomic<bool> go{false};
+
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<num_threads; ++t)
+    {
+        threads.emplace_back([&counter, &go, per_thread](){
+            while(!go.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+            for(size_t i=0; i<per_thread; ++i)
+            {
+                counter.add();
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if(counter.read() != static_cast<std::int64_t>(per_thread * num_threads))
+    {
+        LOG("WRONG COUNT ", counter.read());
+    }
+    return per_thread * num_threads / elapsed.count() / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t total = 8000000;
+    LOG("threads   mutex Mops/s   atomic Mops/s   sharded Mops/s");
+    for(size_t num_threads : {1, 2, 4, 8, 16, 32, 64})
+    {
+        LOG(num_threads, "\t  ", benchmark<MutexCounter>(num_threads, total),
+            "\t ", benchmark<AtomicCounter>(num_threads, total),
+            "\t ", benchmark<ShardedCounter>(num_threads, total));
+    }
+    return 0;
+}
@@ -0,0 +1,631 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
+#include <variant>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * ALLOCATION-FREE TASK SUBMISSION
+ * ThreadPool::enqueue in thread_pool.cpp pays for:
+ *  1. make_shared<packaged_task>    -> control block + task + the future's shared state.
+ *  2. std::bind                     -> stored inside the packaged_task (and may allocate itself).
+ *  3. std::function<void()>         -> the lambda holding the shared_ptr, heap allocated once it
+ *                                      no longer fits std::function's tiny internal buffer.
+ *  4. std::queue (std::deque)       -> a new block every few hundred tasks.
+ *
+ * Fixes used here:
+ *  1. SmallTask: a move-only void() wrapper with a 64 byte inline buffer (small object optimization,
+ *     see optimization_notes/small_object_optimization.cpp). Callables that fit are stored in place,
+ *     bigger ones fall back to the heap.
+ *  2. SharedState<T> objects come from a pool (slabs + free list) and are reference counted by hand
+ *     (one ref for the task, one for the future). Once warmed up, the pool never calls new.
+ *  3. Tasks wait in a ring buffer that only allocates when it has to grow.
+ */
+
+// Same counter idiom as optimization_notes, but atomic since worker threads allocate too.
+std::atomic<size_t> heap_allocations{0};
+void* operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+class SmallTask
+{
+public:
+    static constexpr size_t BUFFER_SIZE = 64;
+
+    SmallTask() = default;
+
+    template <typename F>
+        requires (!std::is_same_v<std::remove_cvref_t<F>, SmallTask>)
+    SmallTask(F&& func)
+    {
+        using Func = std::decay_t<F>;
+        if constexpr(fits_inline<Func>)
+        {
+            ::new (static_cast<void*>(m_storage)) Func(std::forward<F>(func));
+            m_ops = &inline_ops<Func>;
+        }
+        else
+        {
+            ::new (static_cast<void*>(m_storage)) Func*(new Func(std::forward<F>(func)));
+            m_ops = &heap_ops<Func>;
+        }
+    }
+
+    SmallTask(SmallTask&& other) noexcept
+    {
+        take(other);
+    }
+
+    SmallTask& operator=(SmallTask&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    SmallTask(const SmallTask&) = delete;
+    SmallTask& operator=(const SmallTask&) = delete;
+
+    ~SmallTask()
+    {
+        reset();
+    }
+
+    void operator()()
+    {
+        m_ops->invoke(m_storage);
+    }
+
+    explicit operator bool() const
+    {
+        return m_ops != nullptr;
+    }
+
+    void reset()
+    {
+        if(m_ops)
+        {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    /// Hand written vtable: one static instance per stored callable type.
+    struct Ops
+    {
+        void (*invoke)(void*);
+        void (*move)(void* from, void* to);
+        void (*destroy)(void*);
+    };
+
+    template <typename Func>
+    static constexpr bool fits_inline = sizeof(Func) <= BUFFER_SIZE
+                                     && alignof(Func) <= alignof(std::max_align_t)
+                                     && std::is_nothrow_move_constructible_v<Func>;
+
+    template <typename Func>
+    static constexpr Ops inline_ops{
+        [](void* p) { (*static_cast<Func*>(p))(); },
+        [](void* from, void* to) {
+            auto* f = static_cast<Func*>(from);
+            ::new (to) Func(std::move(*f));
+            f->~Func();
+        },
+        [](void* p) { static_cast<Func*>(p)->~Func(); }
+    };
+
+    template <typename Func>
+    static constexpr Ops heap_ops{
+        [](void* p) { (**static_cast<Func**>(p))(); },
+        [](void* from, void* to) { ::new (to) Func*(*static_cast<Func**>(from)); },
+        [](void* p) { delete *static_cast<Func**>(p); }
+    };
+
+    alignas(std::max_align_t) std::byte m_storage[BUFFER_SIZE];
+    const Ops* m_ops = nullptr;
+
+    void take(SmallTask& other) noexcept
+    {
+        if(other.m_ops)
+        {
+            other.m_ops->move(other.m_storage, m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+};
+
+template <typename T>
+struct SharedState
+{
+    /// NOTE: optional<void> is not a thing, so void results store an empty monostate.
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    std::atomic<uint32_t> ready{0};
+    std::atomic<uint32_t> refs{0};
+    std::optional<Value> value;
+    std::exception_ptr error;
+    SharedState* next_free = nullptr;
+};
+
+/// One pool per result type. Slabs are only allocated when the free list runs dry.
+template <typename T>
+class SharedStatePool
+{
+public:
+    static SharedStatePool& instance()
+    {
+        static SharedStatePool pool;
+        return pool;
+    }
+
+    SharedState<T>* acquire()
+    {
+        std::lock_guard lock(m_mutex);
+        if(!m_free)
+        {
+            grow();
+        }
+        SharedState<T>* state = m_free;
+        m_free = state->next_free;
+        state->ready.store(0, std::memory_order_relaxed);
+        state->refs.store(2, std::memory_order_relaxed); // task + future
+        return state;
+    }
+
+    void release(SharedState<T>* state)
+    {
+        if(state->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+        state->value.reset();
+        state->error = nullptr;
+        std::lock_guard lock(m_mutex);
+        state->next_free = m_free;
+        m_free = state;
+    }
+
+private:
+    static constexpr size_t SLAB_SIZE = 256;
+
+    std::mutex m_mutex;
+    SharedState<T>* m_free = nullptr;
+    std::vector<std::unique_ptr<SharedState<T>[]>> m_slabs;
+
+    void grow()
+    {
+        auto slab = std::make_unique<SharedState<T>[]>(SLAB_SIZE);
+        for(size_t i=0; i<SLAB_SIZE; ++i)
+        {
+            slab[i].next_free = m_free;
+            m_free = &slab[i];
+        }
+        m_slabs.push_back(std::move(slab));
+    }
+};
+
+/// Move-only future over a pooled SharedState. get() can be called once, like std::future.
+template <typename T>
+class PooledFuture
+{
+public:
+    PooledFuture() = default;
+    explicit PooledFuture(SharedState<T>* state): m_state(state) {}
+
+    PooledFuture(PooledFuture&& other) noexcept: m_state(std::exchange(other.m_state, nullptr)) {}
+    PooledFuture& operator=(PooledFuture&& other) noexcept
+    {
+        if(this != &other)
+        {
+            release();
+            m_state = std::exchange(other.m_state, nullptr);
+        }
+        return *this;
+    }
+
+    PooledFuture(const PooledFuture&) = delete;
+    PooledFuture& operator=(const PooledFuture&) = delete;
+
+    ~PooledFuture()
+    {
+        release();
+    }
+
+    bool valid() const
+    {
+        return m_state != nullptr;
+    }
+
+    bool is_ready() const
+    {
+        return m_state && m_state->ready.load(std::memory_order_acquire) != 0;
+    }
+
+    void wait() const
+    {
+        while(m_state->ready.load(std::memory_order_acquire) == 0)
+        {
+            m_state->ready.wait(0, std::memory_order_acquire);
+        }
+    }
+
+    T get()
+    {
+        if(!m_state)
+        {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        wait();
+        if(m_state->error)
+        {
+            auto error = m_state->error;
+            release();
+            std::rethrow_exception(error);
+        }
+        if constexpr(std::is_void_v<T>)
+        {
+            release();
+        }
+        else
+        {
+            T result = std::move(*m_state->value);
+            release();
+            return result;
+        }
+    }
+
+private:
+    SharedState<T>* m_state = nullptr;
+
+    void release()
+    {
+        if(m_state)
+        {
+            SharedStatePool<T>::instance().release(m_state);
+            m_state = nullptr;
+        }
+    }
+};
+
+/// The original design from thread_pool.cpp, kept to compare allocations per task.
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push([task]() { (*task)(); });
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+class SmallTaskThreadPool
+{
+public:
+    SmallTaskThreadPool(size_t num_threads = std::thread::hardware_concurrency(),
+                        size_t initial_capacity = 1024)
+    {
+        size_t capacity = 1;
+        while(capacity < initial_capacity)
+        {
+            capacity <<= 1;
+        }
+        m_ring.resize(capacity);
+
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~SmallTaskThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    /// Arguments are moved into the task (no std::bind), results come back through a PooledFuture.
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args&&... args) -> PooledFuture<std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>&...>>
+    {
+        using ReturnType = std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>&...>;
+
+        if(m_stop_flag)
+        {
+            throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+        }
+
+        SharedState<ReturnType>* state = SharedStatePool<ReturnType>::instance().acquire();
+        SmallTask task{
+            [state, func = std::forward<F>(func), ...args = std::forward<Args>(args)]() mutable {
+                try
+                {
+                    if constexpr(std::is_void_v<ReturnType>)
+                    {
+                        std::invoke(func, args...);
+                        state->value.emplace();
+                    }
+                    else
+                    {
+                        state->value.emplace(std::invoke(func, args...));
+                    }
+                }
+                catch(...)
+                {
+                    state->error = std::current_exception();
+                }
+                state->ready.store(1, std::memory_order_release);
+                state->ready.notify_all();
+                SharedStatePool<ReturnType>::instance().release(state);
+            }
+        };
+
+        {
+            std::unique_lock lock(m_queue_mutex);
+            push(std::move(task));
+        }
+        m_queue_cv.notify_one();
+        return PooledFuture<ReturnType>{state};
+    }
+
+    size_t capacity()
+    {
+        std::lock_guard lock(m_queue_mutex);
+        return m_ring.size();
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::vector<SmallTask> m_ring;  // size is always a power of two.
+    size_t m_head{0};
+    size_t m_count{0};
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    // Both called with m_queue_mutex held.
+    void push(SmallTask&& task)
+    {
+        if(m_count == m_ring.size())
+        {
+            std::vector<SmallTask> bigger(m_ring.size() * 2);
+            for(size_t i=0; i<m_count; ++i)
+            {
+                bigger[i] = std::move(m_ring[(m_head + i) & (m_ring.size() - 1)]);
+            }
+            m_ring = std::move(bigger);
+            m_head = 0;
+        }
+        m_ring[(m_head + m_count) & (m_ring.size() - 1)] = std::move(task);
+        ++m_count;
+    }
+
+    SmallTask pop()
+    {
+        SmallTask task = std::move(m_ring[m_head]);
+        m_head = (m_head + 1) & (m_ring.size() - 1);
+        --m_count;
+        return task;
+    }
+
+    void worker()
+    {
+        while(true)
+        {
+            SmallTask task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || m_count > 0;
+                });
+
+                if(m_stop_flag && m_count == 0)
+                {
+                    return;
+                }
+
+                task = pop();
+            }
+            task();
+        }
+    }
+};
+
+/**
+ * TEST: submit num_tasks small tasks and count operator new calls between the first enqueue and
+ * the last get(). The first round on SmallTaskThreadPool is a warm-up that fills the SharedState
+ * pool with slabs; its ring is sized up front so it never grows.
+ */
+template <typename Pool>
+size_t count_allocations(Pool& pool, size_t num_tasks)
+{
+    using Future = decltype(pool.enqueue([](int i){ return i; }, 0));
+    std::vector<Future> results;
+    results.reserve(num_tasks);
+
+    heap_allocations = 0;
+    for(size_t i=0; i<num_tasks; ++i)
+    {
+        results.push_back(pool.enqueue([](int i){ return i * 2; }, static_cast<int>(i)));
+    }
+    size_t sum = 0;
+    for(auto& result: results)
+    {
+        sum += result.get();
+    }
+    size_t count = heap_allocations;
+    if(sum != num_tasks * (num_tasks - 1))
+    {
+        LOG("Wrong results!");
+    }
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t num_tasks = 10000;
+    constexpr size_t num_threads = 4;
+
+    size_t baseline = 0;
+    {
+        ThreadPool pool(num_threads);
+        baseline = count_allocations(pool, num_tasks);
+    }
+    LOG("ThreadPool (std::future):           ", baseline, " allocations for ", num_tasks, " tasks (",
+        static_cast<double>(baseline) / num_tasks, " per task)");
+
+    size_t pooled = 0;
+    {
+        SmallTaskThreadPool pool(num_threads, num_tasks);
+        count_allocations(pool, num_tasks);
+        pooled = count_allocations(pool, num_tasks);
+    }
+    LOG("SmallTaskThreadPool (PooledFuture): ", pooled, " allocations for ", num_tasks, " tasks");
+
+    // Exceptions and void results travel through the same pooled state.
+    SmallTaskThreadPool pool(2);
+    auto failing = pool.enqueue([](){ throw std::runtime_error("Divide by Zero Exception"); });
+    try
+    {
+        failing.get();
+    }
+    catch(const std::exception& e)
+    {
+        LOG("Caught ", e.what());
+    }
+
+    if(pooled != 0)
+    {
+        LOG("FAILED: expected zero heap allocations per task after warm-up");
+        return 1;
+    }
+    LOG("PASSED: zero heap allocations per task after warm-up");
+    return 0;
+}
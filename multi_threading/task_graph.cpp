@@ -0,0 +1,404 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <initializer_list>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * TASK GRAPH (DAG) ON TOP OF ThreadPool
+ * Chaining with future.get() inside a task parks a worker until the other task is done. Once every
+ * worker is parked like that, nobody is left to run the tasks they wait for -> deadlock.
+ *
+ * A task graph avoids waiting altogether:
+ *  1. Every node knows its successors and how many predecessors it has.
+ *  2. At the start of a run each node gets pending = number of predecessors. Roots (pending == 0)
+ *     are enqueued right away.
+ *  3. When a node finishes it decrements pending of every successor. Whoever brings it to zero
+ *     enqueues that successor. So a node is scheduled the moment its LAST predecessor finishes.
+ *  4. Nothing about the structure changes during a run, so run() can be called again and again on
+ *     the same graph; it only resets the counters.
+ *
+ * If a node throws, the exception goes to the future returned by run() and every node that has not
+ * started yet is skipped (it still counts as finished so the run completes).
+ */
+
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        /// NOTE: shared_ptr is used here so that we can share ownership between
+        /// worker thread and pool.
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push([task]() { (*task)(); });
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+class TaskGraph
+{
+public:
+    using NodeId = size_t;
+
+    /// Adds a node that runs after all `predecessors` are done. Predecessors must already exist.
+    NodeId add(std::function<void()> work, std::initializer_list<NodeId> predecessors = {})
+    {
+        return add(std::move(work), std::vector<NodeId>(predecessors));
+    }
+
+    NodeId add(std::function<void()> work, const std::vector<NodeId>& predecessors)
+    {
+        throw_if_running();
+        NodeId id = m_nodes.size();
+        m_nodes.push_back(Node{std::move(work), {}, 0});
+        m_validated = false;
+        for(NodeId before : predecessors)
+        {
+            precede(before, id);
+        }
+        return id;
+    }
+
+    /// Adds the edge before -> after.
+    void precede(NodeId before, NodeId after)
+    {
+        throw_if_running();
+        if(before >= m_nodes.size() || after >= m_nodes.size() || before == after)
+        {
+            throw std::invalid_argument("TaskGraph: bad edge");
+        }
+        m_nodes[before].successors.push_back(after);
+        ++m_nodes[after].num_predecessors;
+        m_validated = false;
+    }
+
+    size_t size() const
+    {
+        return m_nodes.size();
+    }
+
+    /**
+     * Schedules the whole graph on `pool` and returns immediately. The future becomes ready once
+     * every node has finished (or was skipped). The graph must stay alive until then and must not
+     * be run again before that.
+     */
+    std::future<void> run(ThreadPool& pool)
+    {
+        throw_if_running();
+        validate();
+
+        m_promise = std::promise<void>{};
+        auto result = m_promise.get_future();
+        if(m_nodes.empty())
+        {
+            m_promise.set_value();
+            return result;
+        }
+
+        m_error = nullptr;
+        m_failed.store(false, std::memory_order_relaxed);
+        m_remaining.store(m_nodes.size(), std::memory_order_relaxed);
+        for(NodeId id=0; id<m_nodes.size(); ++id)
+        {
+            m_pending[id].store(m_nodes[id].num_predecessors, std::memory_order_relaxed);
+        }
+        m_running = true;
+
+        for(NodeId root : m_roots)
+        {
+            schedule(pool, root);
+        }
+        return result;
+    }
+
+private:
+    struct Node
+    {
+        std::function<void()> work;
+        std::vector<NodeId> successors;
+        size_t num_predecessors;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<NodeId> m_roots;
+    bool m_validated{false};
+
+    /// Per-run state. Atomics can't live in a growing vector, hence the separate array.
+    std::unique_ptr<std::atomic<size_t>[]> m_pending;
+    std::atomic<size_t> m_remaining{0};
+    std::atomic<bool> m_failed{false};
+    std::atomic<bool> m_running{false};
+    std::mutex m_error_mutex;
+    std::exception_ptr m_error;
+    std::promise<void> m_promise;
+
+    void throw_if_running() const
+    {
+        if(m_running)
+        {
+            throw std::logic_error("TaskGraph is running");
+        }
+    }
+
+    /// Kahn's algorithm, only to reject cycles up front (a cycle would never finish). Cached until
+    /// the structure changes, so re-runs skip it.
+    void validate()
+    {
+        if(m_validated)
+        {
+            return;
+        }
+        std::vector<size_t> in_degree(m_nodes.size());
+        m_roots.clear();
+        for(NodeId id=0; id<m_nodes.size(); ++id)
+        {
+            in_degree[id] = m_nodes[id].num_predecessors;
+            if(in_degree[id] == 0)
+            {
+                m_roots.push_back(id);
+            }
+        }
+        std::vector<NodeId> ready = m_roots;
+        size_t visited = 0;
+        while(!ready.empty())
+        {
+            NodeId id = ready.back();
+            ready.pop_back();
+            ++visited;
+            for(NodeId next : m_nodes[id].successors)
+            {
+                if(--in_degree[next] == 0)
+                {
+                    ready.push_back(next);
+                }
+            }
+        }
+        if(visited != m_nodes.size())
+        {
+            throw std::logic_error("TaskGraph has a cycle");
+        }
+        m_pending = std::make_unique<std::atomic<size_t>[]>(m_nodes.size());
+        m_validated = true;
+    }
+
+    void schedule(ThreadPool& pool, NodeId id)
+    {
+        // The returned future is dropped on purpose: completion is tracked by m_remaining.
+        pool.enqueue([this, &pool, id](){ execute(pool, id); });
+    }
+
+    void execute(ThreadPool& pool, NodeId id)
+    {
+        if(!m_failed.load(std::memory_order_acquire))
+        {
+            try
+            {
+                m_nodes[id].work();
+            }
+            catch(...)
+            {
+                std::lock_guard lock(m_error_mutex);
+                if(!m_error)
+                {
+                    m_error = std::current_exception();
+                }
+                m_failed.store(true, std::memory_order_release);
+            }
+        }
+
+        for(NodeId next : m_nodes[id].successors)
+        {
+            // acq_rel: the successor must see everything its predecessors wrote.
+            if(m_pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                schedule(pool, next);
+            }
+        }
+
+        if(m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            // Once m_running is false the caller may run the graph again (new m_promise, m_error)
+            // or destroy it, so take the result out first and only complete the local promise.
+            std::promise<void> promise = std::move(m_promise);
+            std::exception_ptr error = std::move(m_error);
+            m_running = false;
+            if(error)
+            {
+                promise.set_exception(error);
+            }
+            else
+            {
+                promise.set_value();
+            }
+        }
+    }
+};
+
+/**
+ * BENCHMARK: a wide and deep DAG. `depth` layers of `width` nodes, each node depends on two nodes
+ * of the previous layer. Compared against the usual workaround without a graph: the main thread
+ * enqueues a layer, waits for all of its futures, then enqueues the next one.
+ */
+void build_layers(TaskGraph& graph, size_t width, size_t depth, std::atomic<size_t>& counter)
+{
+    std::vector<TaskGraph::NodeId> previous;
+    for(size_t layer=0; layer<depth; ++layer)
+    {
+        std::vector<TaskGraph::NodeId> current;
+        for(size_t i=0; i<width; ++i)
+        {
+            auto work = [&counter](){ counter.fetch_add(1, std::memory_order_relaxed); };
+            if(previous.empty())
+            {
+                current.push_back(graph.add(work));
+            }
+            else
+            {
+                current.push_back(graph.add(work, {previous[i], previous[(i + 1) % width]}));
+            }
+        }
+        previous = std::move(current);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t width = 256;
+    constexpr size_t depth = 64;
+    constexpr size_t runs = 5;
+
+    ThreadPool pool(4);
+    std::atomic<size_t> counter{0};
+
+    TaskGraph graph;
+    build_layers(graph, width, depth, counter);
+
+    for(size_t run=0; run<runs; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        graph.run(pool).get();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        LOG("graph run ", run, ": ", static_cast<size_t>(graph.size() / elapsed.count()), " nodes/s");
+    }
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(size_t layer=0; layer<depth; ++layer)
+        {
+            std::vector<std::future<void>> results;
+            for(size_t i=0; i<width; ++i)
+            {
+                results.push_back(pool.enqueue([&counter](){ counter.fetch_add(1, std::memory_order_relaxed); }));
+            }
+            for(auto& result: results)
+            {
+                result.get();
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        LOG("layer by layer: ", static_cast<size_t>(width * depth / elapsed.count()), " nodes/s");
+    }
+    LOG("nodes executed ", counter.load(), " (expected ", (runs + 1) * width * depth, ")");
+
+    // Diamond with a failing node: D never runs, the error reaches the caller.
+    TaskGraph diamond;
+    auto a = diamond.add([](){ LOG("A"); });
+    auto b = diamond.add([](){ throw std::runtime_error("B failed"); }, {a});
+    auto c = diamond.add([](){ LOG("C"); }, {a});
+    diamond.add([](){ LOG("D (never printed)"); }, {b, c});
+    try
+    {
+        diamond.run(pool).get();
+    }
+    catch(const std::exception& e)
+    {
+        LOG("Caught ", e.what());
+    }
+    return 0;
+}
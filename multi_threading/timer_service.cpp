@@ -0,0 +1,574 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <random>
+#include <bit>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * TIMER WHEEL SERVICE
+ * talker_non_stop in simple_threads.cpp is the usual periodic worker: loop { work; sleep 1s } until
+ * stop_requested(). One thread per periodic job, the period drifts by the time the work takes, and a
+ * stop request has to wait for the sleep to end, up to a whole period.
+ *
+ * TimerService runs thousands of periodic and one-shot callbacks on a few std::jthreads:
+ *  1. Hashed timer wheel (Varghese & Lauck): SLOTS buckets of one TICK each cover the next
+ *     SLOTS * TICK. A timer goes into bucket (deadline tick % SLOTS), so scheduling and cancelling
+ *     are O(1). Timers further out wait in an overflow map until the wheel gets close enough.
+ *  2. No polling: a bitmap of occupied buckets finds the next non-empty one, and the timer thread
+ *     sleeps until the exact earliest deadline in it (wait_until), not tick by tick. Scheduling an
+ *     earlier timer wakes it up to plan again.
+ *  3. The timer thread only takes due timers out of the wheel and re-arms the periodic ones. Callbacks
+ *     run on the worker threads, so a slow callback doesn't push back everybody else's deadline.
+ *     Periodic timers are fixed rate (deadline += period, no drift). A periodic timer whose callback
+ *     is still running when it's due again skips that round instead of running twice at once.
+ *  4. Prompt stop: std::condition_variable is cheaper than condition_variable_any, and a
+ *     std::stop_callback on each jthread's token notifies it. A stop request wakes the thread right
+ *     away, whatever deadline it was sleeping towards.
+ */
+
+using Clock = std::chrono::steady_clock;
+using TimerId = std::uint64_t;
+
+class TimerService
+{
+public:
+    static constexpr Clock::duration TICK = std::chrono::milliseconds(1);
+    static constexpr size_t SLOTS = 4096; // power of 2, ~4s until timers go to the overflow map
+
+    struct Stats
+    {
+        std::uint64_t fired;
+        std::uint64_t skipped;  // periodic rounds skipped because the previous one was still running
+        std::uint64_t wakeups;  // times the timer thread woke up
+    };
+
+    explicit TimerService(size_t num_workers = 2):
+        m_epoch(Clock::now()),
+        m_wheel(SLOTS)
+    {
+        m_threads.emplace_back([this](std::stop_token stoken){ timer_loop(stoken); });
+        for(size_t i=0; i<std::max<size_t>(num_workers, 1); ++i)
+        {
+            m_threads.emplace_back([this](std::stop_token stoken){ worker_loop(stoken); });
+        }
+    }
+
+    /// Callbacks that are queued but haven't started yet are dropped.
+    ~TimerService()
+    {
+        // Ask all of them first so they stop in parallel, then join.
+        for(auto& thread: m_threads)
+        {
+            thread.request_stop();
+        }
+        m_threads.clear();
+    }
+
+    /// One-shot. f() or f(Clock::time_point deadline), the latter receives the deadline it was due at.
+    template <typename F>
+    TimerId schedule_after(Clock::duration delay, F&& f)
+    {
+        return add(Clock::now() + delay, Clock::duration::zero(), std::forward<F>(f));
+    }
+
+    /// Periodic, first run one period from now.
+    template <typename F>
+    TimerId schedule_every(Clock::duration period, F&& f)
+    {
+        if(period <= Clock::duration::zero())
+        {
+            throw std::invalid_argument("TimerService: period must be positive");
+        }
+        return add(Clock::now() + period, period, std::forward<F>(f));
+    }
+
+    /// Moves the next deadline to now + delay (e.g. a cache entry that was used again).
+    /// False if the timer was cancelled or was a one-shot that already fired.
+    bool reschedule(TimerId id, Clock::duration delay)
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_timers.find(id);
+        if(it == m_timers.end())
+        {
+            return false;
+        }
+        Clock::time_point deadline = Clock::now() + delay;
+        if(deadline != it->second.deadline)
+        {
+            // The old wheel entry stays behind and is skipped because its deadline no longer matches.
+            it->second.deadline = deadline;
+            insert(deadline, id);
+            wake_if_earlier(deadline);
+        }
+        return true;
+    }
+
+    /// False if the timer was already cancelled or was a one-shot that already fired. A callback that
+    /// is running right now finishes.
+    bool cancel(TimerId id)
+    {
+        std::lock_guard lock(m_mutex);
+        return m_timers.erase(id) > 0;
+    }
+
+    Stats stats()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    using Callback = std::function<void(Clock::time_point)>;
+
+    struct Timer
+    {
+        Clock::time_point deadline;
+        Clock::duration period;  // zero: one-shot
+        std::shared_ptr<Callback> callback;
+        bool running{false};
+    };
+
+    struct Entry
+    {
+        Clock::time_point deadline;
+        TimerId id;
+    };
+
+    struct Job
+    {
+        TimerId id;
+        Clock::time_point deadline;
+        std::shared_ptr<Callback> callback;
+    };
+
+    static constexpr size_t MASK = SLOTS - 1;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;  // timer thread
+    std::condition_variable m_ready;   // workers
+    const Clock::time_point m_epoch;
+    std::unordered_map<TimerId, Timer> m_timers;
+    std::vector<std::vector<Entry>> m_wheel;
+    std::array<std::uint64_t, SLOTS / 64> m_occupied{};
+    std::multimap<Clock::time_point, TimerId> m_overflow;
+    std::uint64_t m_cursor{0};  // wheel position in ticks since m_epoch, every earlier tick is done
+    Clock::time_point m_planned{Clock::time_point::max()};  // what the timer thread sleeps towards
+    std::vector<Entry> m_due;
+    std::deque<Job> m_jobs;
+    TimerId m_next_id{1};
+    Stats m_stats{};
+    /// NOTE: Last member: the threads use everything above and have to be gone before it is.
+    std::vector<std::jthread> m_threads;
+
+    template <typename F>
+    TimerId add(Clock::time_point deadline, Clock::duration period, F&& f)
+    {
+        auto callback = std::make_shared<Callback>();
+        if constexpr(std::is_invocable_v<std::decay_t<F>&, Clock::time_point>)
+        {
+            *callback = std::forward<F>(f);
+        }
+        else
+        {
+            *callback = [fn = std::forward<F>(f)](Clock::time_point) mutable { fn(); };
+        }
+
+        std::lock_guard lock(m_mutex);
+        TimerId id = m_next_id++;
+        m_timers.emplace(id, Timer{deadline, period, std::move(callback)});
+        insert(deadline, id);
+        wake_if_earlier(deadline);
+        return id;
+    }
+
+    std::uint64_t tick_of(Clock::time_point time) const
+    {
+        return time <= m_epoch ? 0 : static_cast<std::uint64_t>((time - m_epoch) / TICK);
+    }
+
+    void wake_if_earlier(Clock::time_point deadline)
+    {
+        if(deadline < m_planned)
+        {
+            m_wakeup.notify_one();
+        }
+    }
+
+    /// Lock held. Deadlines in the past go into the current bucket and fire on the next pass.
+    void insert(Clock::time_point deadline, TimerId id)
+    {
+        std::uint64_t tick = std::max(tick_of(deadline), m_cursor);
+        if(tick >= m_cursor + SLOTS)
+        {
+            m_overflow.emplace(deadline, id);
+            return;
+        }
+        size_t slot = tick & MASK;
+        m_wheel[slot].push_back({deadline, id});
+        m_occupied[slot / 64] |= std::uint64_t{1} << (slot % 64);
+    }
+
+    /// First tick at or after `from` whose bucket isn't empty, m_cursor + SLOTS if there is none.
+    /// Every wheel entry is in [m_cursor, m_cursor + SLOTS), so a bucket maps back to one tick.
+    std::uint64_t next_occupied(std::uint64_t from) const
+    {
+        const std::uint64_t end = m_cursor + SLOTS;
+        for(std::uint64_t tick=from; tick<end; )
+        {
+            size_t slot = tick & MASK;
+            std::uint64_t bits = m_occupied[slot / 64] >> (slot % 64);
+            if(bits)
+            {
+                return std::min(tick + std::countr_zero(bits), end);
+            }
+            tick += 64 - slot % 64;
+        }
+        return end;
+    }
+
+    Clock::time_point next_deadline() const
+    {
+        std::uint64_t tick = next_occupied(m_cursor);
+        if(tick < m_cursor + SLOTS)
+        {
+            const auto& bucket = m_wheel[tick & MASK];
+            return std::min_element(bucket.begin(), bucket.end(),
+                [](const Entry& a, const Entry& b){ return a.deadline < b.deadline; })->deadline;
+        }
+        return m_overflow.empty() ? Clock::time_point::max() : m_overflow.begin()->first;
+    }
+
+    /// Moves every entry of the bucket with deadline <= now to m_due.
+    void take_due(size_t slot, Clock::time_point now)
+    {
+        auto& bucket = m_wheel[slot];
+        auto later = std::partition(bucket.begin(), bucket.end(),
+                                    [now](const Entry& entry){ return entry.deadline > now; });
+        m_due.insert(m_due.end(), later, bucket.end());
+        bucket.erase(later, bucket.end());
+        if(bucket.empty())
+        {
+            m_occupied[slot / 64] &= ~(std::uint64_t{1} << (slot % 64));
+        }
+    }
+
+    /// Lock held. Advances the wheel to `now` and hands every due timer to the workers.
+    void collect_due(Clock::time_point now)
+    {
+        const std::uint64_t now_tick = tick_of(now);
+        while(true)
+        {
+            while(!m_overflow.empty() && tick_of(m_overflow.begin()->first) < m_cursor + SLOTS)
+            {
+                insert(m_overflow.begin()->first, m_overflow.begin()->second);
+                m_overflow.erase(m_overflow.begin());
+            }
+            take_due(m_cursor & MASK, now);
+            if(m_cursor >= now_tick)
+            {
+                break; // the current tick may still hold later deadlines, it isn't done yet
+            }
+            m_cursor = std::min(next_occupied(m_cursor + 1), now_tick);
+        }
+
+        for(const Entry& entry: m_due)
+        {
+            auto it = m_timers.find(entry.id);
+            if(it == m_timers.end() || it->second.deadline != entry.deadline)
+            {
+                continue; // cancelled or rescheduled
+            }
+            Timer& timer = it->second;
+            if(timer.running)
+            {
+                ++m_stats.skipped;
+            }
+            else
+            {
+                timer.running = true;
+                m_jobs.push_back({entry.id, entry.deadline, timer.callback});
+                m_ready.notify_one();
+                ++m_stats.fired;
+            }
+
+            if(timer.period == Clock::duration::zero())
+            {
+                m_timers.erase(it); // the job holds its own reference to the callback
+                continue;
+            }
+            // Fixed rate. If we are more than a period late, skip the rounds that are already over.
+            auto missed = (now - timer.deadline) / timer.period;
+            timer.deadline += (missed + 1) * timer.period;
+            insert(timer.deadline, entry.id);
+        }
+        m_due.clear();
+    }
+
+    void timer_loop(std::stop_token stoken)
+    {
+        // Under the mutex: either we haven't checked stop_requested() yet, or we are already waiting.
+        std::stop_callback wake_on_stop(stoken, [this](){
+            std::lock_guard lock(m_mutex);
+            m_wakeup.notify_all();
+        });
+
+        std::unique_lock lock(m_mutex);
+        while(!stoken.stop_requested())
+        {
+            collect_due(Clock::now());
+            m_planned = next_deadline();
+            if(m_planned == Clock::time_point::max())
+            {
+                m_wakeup.wait(lock);
+            }
+            else
+            {
+                m_wakeup.wait_until(lock, m_planned);
+            }
+            ++m_stats.wakeups;
+        }
+    }
+
+    void worker_loop(std::stop_token stoken)
+    {
+        std::stop_callback wake_on_stop(stoken, [this](){
+            std::lock_guard lock(m_mutex);
+            m_ready.notify_all();
+        });
+
+        std::unique_lock lock(m_mutex);
+        while(true)
+        {
+            m_ready.wait(lock, [&](){ return stoken.stop_requested() || !m_jobs.empty(); });
+            if(stoken.stop_requested())
+            {
+                return;
+            }
+            Job job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+
+            lock.unlock();
+            try
+            {
+                (*job.callback)(job.deadline);
+            }
+            catch(const std::exception& e)
+            {
+                LOG("Timer ", job.id, " threw: ", e.what());
+            }
+            catch(...)
+            {
+                LOG("Timer ", job.id, " threw an unknown exception");
+            }
+            lock.lock();
+
+            if(auto it = m_timers.find(job.id); it != m_timers.end())
+            {
+                it->second.running = false;
+            }
+        }
+    }
+};
+
+/// Same as in dynamic_bounded_buffer.cpp: power of 2 buckets in ns.
+class LatencyHistogram
+{
+public:
+    void record(std::chrono::nanoseconds latency)
+    {
+        auto ns = static_cast<unsigned long long>(std::max<long long>(latency.count(), 1));
+        size_t bucket = std::min<size_t>(std::bit_width(ns) - 1, BUCKETS - 1);
+        ++m_buckets[bucket];
+        ++m_count;
+        m_max = std::max(m_max, ns);
+    }
+
+    unsigned long long count() const { return m_count; }
+
+    unsigned long long percentile(double p) const
+    {
+        auto target = static_cast<unsigned long long>(p * m_count);
+        unsigned long long seen = 0;
+        for(size_t i=0; i<BUCKETS; ++i)
+        {
+            seen += m_buckets[i];
+            if(seen > target)
+            {
+                return std::min(2ull << i, m_max);
+            }
+        }
+        return m_max;
+    }
+
+    void print(const std::string& label) const
+    {
+        LOG(label, ": ", m_count, " fired, late by p50 ", percentile(0.50) / 1000.0, "us, p99 ",
+            percentile(0.99) / 1000.0, "us, p99.9 ", percentile(0.999) / 1000.0, "us, max ", m_max / 1000.0, "us");
+    }
+
+private:
+    static constexpr size_t BUCKETS = 40;
+    std::array<unsigned long long, BUCKETS> m_buckets{};
+    unsigned long long m_count{0};
+    unsigned long long m_max{0};
+};
+
+/**
+ * BENCHMARK: jitter with `num_timers` periodic timers, periods spread over 50ms..1s. Every callback
+ * records how late it runs compared to its deadline.
+ * Baseline: one talker_non_stop style thread that sleeps one tick and scans every timer.
+ */
+std::vector<Clock::duration> random_periods(size_t num_timers)
+{
+    std::mt19937 engine(42);
+    std::uniform_int_distribution<int> period_ms(50, 1000);
+    std::vector<Clock::duration> periods;
+    for(size_t i=0; i<num_timers; ++i)
+    {
+        periods.push_back(std::chrono::milliseconds(period_ms(engine)));
+    }
+    return periods;
+}
+
+void timer_wheel_jitter(size_t num_timers, Clock::duration run_for)
+{
+    std::mutex histogram_mutex;
+    LatencyHistogram histogram;
+    TimerService::Stats stats;
+    {
+        TimerService service(2);
+        for(Clock::duration period: random_periods(num_timers))
+        {
+            service.schedule_every(period, [&](Clock::time_point deadline){
+                auto late = Clock::now() - deadline;
+                std::lock_guard lock(histogram_mutex);
+                histogram.record(late);
+            });
+        }
+        std::this_thread::sleep_for(run_for);
+        stats = service.stats();
+    }
+    histogram.print("TimerService, " + std::to_string(num_timers) + " timers");
+    LOG("    timer thread wakeups: ", stats.wakeups, ", skipped rounds: ", stats.skipped);
+}
+
+void polling_jitter(size_t num_timers, Clock::duration run_for)
+{
+    LatencyHistogram histogram;
+    std::uint64_t wakeups = 0;
+    {
+        std::vector<Clock::duration> periods = random_periods(num_timers);
+        std::vector<Clock::time_point> deadlines;
+        Clock::time_point start = Clock::now();
+        for(Clock::duration period: periods)
+        {
+            deadlines.push_back(start + period);
+        }
+
+        std::jthread poller([&](std::stop_token stoken){
+            while(!stoken.stop_requested())
+            {
+                std::this_thread::sleep_for(TimerService::TICK);
+                ++wakeups;
+                Clock::time_point now = Clock::now();
+                for(size_t i=0; i<deadlines.size(); ++i)
+                {
+                    if(deadlines[i] <= now)
+                    {
+                        histogram.record(Clock::now() - deadlines[i]);
+                        deadlines[i] += periods[i];
+                    }
+                }
+            }
+        });
+        std::this_thread::sleep_for(run_for);
+    }
+    histogram.print("Polling every 1ms, " + std::to_string(num_timers) + " timers");
+    LOG("    poller wakeups: ", wakeups);
+}
+
+int main(int argc, char** argv)
+{
+    using namespace std::chrono_literals;
+
+    // Heartbeat: periodic, cancelled after a while.
+    {
+        TimerService service(1);
+        std::atomic<int> beats{0};
+        TimerId heartbeat = service.schedule_every(100ms, [&](){ LOG("Heartbeat ", ++beats); });
+        std::this_thread::sleep_for(350ms);
+        service.cancel(heartbeat);
+        std::this_thread::sleep_for(150ms);
+        LOG("Heartbeats after cancel: ", beats.load(), " (expected 3)");
+    }
+
+    // Cache expiry: every entry gets a one-shot timer, a read pushes it back.
+    {
+        TimerService service(1);
+        std::mutex cache_mutex;
+        std::map<std::string, TimerId> cache;
+        auto put = [&](const std::string& key){
+            std::lock_guard lock(cache_mutex);
+            cache[key] = service.schedule_after(100ms, [&, key](){
+                std::lock_guard lock(cache_mutex);
+                cache.erase(key);
+            });
+        };
+        put("alice");
+        put("bob");
+        put("carol");
+        std::this_thread::sleep_for(60ms);
+        {
+            std::lock_guard lock(cache_mutex);
+            service.reschedule(cache["bob"], 100ms);
+        }
+        std::this_thread::sleep_for(80ms);
+        std::lock_guard lock(cache_mutex);
+        std::string left;
+        for(const auto& [key, id]: cache)
+        {
+            left += key + " ";
+        }
+        LOG("Cache after 140ms: ", left, "(expected bob)");
+    }
+
+    // Stop doesn't wait for the next deadline, unlike talker_non_stop's sleep.
+    {
+        auto service = std::make_unique<TimerService>(2);
+        service->schedule_every(10s, [](){});
+        std::this_thread::sleep_for(10ms);
+        auto start = Clock::now();
+        service.reset();
+        LOG("Stopped with a 10s timer pending in ",
+            std::chrono::duration<double, std::micro>(Clock::now() - start).count(), "us");
+    }
+
+    for(size_t num_timers : {1000, 10000})
+    {
+        timer_wheel_jitter(num_timers, 3s);
+        polling_jitter(num_timers, 3s);
+    }
+    return 0;
+}
@@ -0,0 +1,579 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <latch>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <iterator>
+#include <cctype>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * TOPOLOGY AWARE ThreadPool (Linux only)
+ * On a two socket machine a task that hops to the other socket finds none of its data in the local
+ * caches and pays remote memory latency. So:
+ *  1. Read the machine layout from /sys (no libnuma needed):
+ *      /sys/devices/system/cpu/online                           -> "0-63"
+ *      /sys/devices/system/cpu/cpuN/nodeM                       -> cpuN belongs to NUMA node M
+ *      /sys/devices/system/cpu/cpuN/cache/indexK/{level,shared_cpu_list} -> CPUs sharing the L3
+ *  2. Group CPUs into domains (one per NUMA node, or one per L3 cache), start one worker per CPU (at
+ *     most num_threads, spread round-robin over the domains) and optionally pin it there with
+ *     pthread_setaffinity_np. The worker pins itself before it takes its first task.
+ *  3. Each worker owns a deque (same scheme as work_stealing_thread_pool.cpp). An idle worker steals
+ *     from workers in its OWN domain first and only then from remote domains.
+ *  4. enqueue_on(domain, ...) lets the caller place a task next to its data. Such a task stays in its
+ *     domain: workers of the same domain may steal it, remote ones may not.
+ *
+ * cpulist format: comma separated CPUs or ranges, e.g. "0-3,8,10-11".
+ */
+
+std::vector<int> parse_cpu_list(const std::string& text)
+{
+    std::vector<int> cpus;
+    std::stringstream stream(text);
+    std::string part;
+    while(std::getline(stream, part, ','))
+    {
+        if(part.empty() || part == "\n")
+        {
+            continue;
+        }
+        auto dash = part.find('-');
+        int first = std::stoi(part.substr(0, dash));
+        int last = (dash == std::string::npos) ? first : std::stoi(part.substr(dash + 1));
+        for(int cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::string read_sys_file(const std::filesystem::path& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+enum class Grouping
+{
+    NumaNode,
+    L3Cache
+};
+
+struct CpuTopology
+{
+    struct Domain
+    {
+        int id;                 // NUMA node number, or the first CPU sharing the L3.
+        std::vector<int> cpus;
+    };
+    std::vector<Domain> domains;
+
+    /// CPUs that are online AND that this process is allowed to run on (taskset, cgroups).
+    static std::vector<int> usable_cpus()
+    {
+        std::vector<int> online = parse_cpu_list(read_sys_file("/sys/devices/system/cpu/online"));
+        if(online.empty())
+        {
+            for(unsigned i=0; i<std::thread::hardware_concurrency(); ++i)
+            {
+                online.push_back(static_cast<int>(i));
+            }
+        }
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            return online;
+        }
+        std::vector<int> usable;
+        std::copy_if(online.begin(), online.end(), std::back_inserter(usable),
+                     [&](int cpu){ return CPU_ISSET(cpu, &allowed); });
+        return usable.empty() ? online : usable;
+    }
+
+    static CpuTopology read(Grouping grouping)
+    {
+        namespace fs = std::filesystem;
+        std::vector<int> cpus = usable_cpus();
+        std::map<int, std::vector<int>> groups;
+
+        for(int cpu : cpus)
+        {
+            int key = 0; // Fallback: everything in one domain.
+            std::error_code ec;
+            if(grouping == Grouping::NumaNode)
+            {
+                // cpuN has a "nodeM" entry pointing at its NUMA node.
+                for(const auto& entry : fs::directory_iterator("/sys/devices/system/cpu/cpu" + std::to_string(cpu), ec))
+                {
+                    std::string name = entry.path().filename().string();
+                    if(name.rfind("node", 0) == 0 && name.size() > 4 && std::isdigit(static_cast<unsigned char>(name[4])))
+                    {
+                        key = std::stoi(name.substr(4));
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                fs::path cache = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache";
+                for(const auto& entry : fs::directory_iterator(cache, ec))
+                {
+                    if(read_sys_file(entry.path() / "level") == "3")
+                    {
+                        auto shared = parse_cpu_list(read_sys_file(entry.path() / "shared_cpu_list"));
+                        if(!shared.empty())
+                        {
+                            key = shared.front();
+                        }
+                        break;
+                    }
+                }
+            }
+            groups[key].push_back(cpu);
+        }
+
+        CpuTopology topology;
+        for(auto& [id, members] : groups)
+        {
+            topology.domains.push_back(Domain{id, std::move(members)});
+        }
+        return topology;
+    }
+};
+
+struct TopologyOptions
+{
+    Grouping grouping{Grouping::NumaNode};
+    bool pin_workers{true};
+};
+
+/// Pins the calling thread.
+bool pin_to_cpu(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+class TopologyThreadPool
+{
+public:
+    struct WorkerStats
+    {
+        int cpu;
+        size_t domain;
+        size_t local;         // popped from its own deque
+        size_t stolen_near;   // stolen inside its domain
+        size_t stolen_far;    // stolen from another domain
+    };
+
+    /// One worker per usable CPU, but no more than num_threads. topology() only lists the CPUs (and
+    /// domains) that got a worker.
+    TopologyThreadPool(size_t num_threads = std::thread::hardware_concurrency(), TopologyOptions options = {}):
+        m_topology(select_cpus(CpuTopology::read(options.grouping), std::max<size_t>(num_threads, 1))),
+        m_pin_workers(options.pin_workers)
+    {
+        for(size_t d=0; d<m_topology.domains.size(); ++d)
+        {
+            std::vector<size_t> members;
+            for(int cpu : m_topology.domains[d].cpus)
+            {
+                members.push_back(m_queues.size());
+                m_queues.push_back(std::make_unique<WorkQueue>());
+                m_queues.back()->cpu = cpu;
+                m_queues.back()->domain = d;
+            }
+            m_domain_workers.push_back(std::move(members));
+        }
+        m_domain_pending = std::make_unique<std::atomic<size_t>[]>(m_domain_workers.size());
+        build_steal_orders();
+
+        for(size_t i=0; i<m_queues.size(); ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this, i]{ worker(i);}
+            });
+        }
+    }
+
+    ~TopologyThreadPool()
+    {
+        {
+            std::lock_guard lock(m_sleep_mutex);
+            m_stop_flag = true;
+        }
+
+        m_sleep_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    /// Same API as ThreadPool. From a worker the task stays local, from outside it goes round-robin.
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        size_t index = (t_owner == this)
+            ? t_index
+            : m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        return push(index, Placement::Anywhere, std::forward<F>(func), std::forward<Args>(args)...);
+    }
+
+    /// Places the task on a worker of `domain`, e.g. the NUMA node that owns the data. Only workers
+    /// of that domain run it.
+    template <typename F, typename... Args>
+    auto enqueue_on(size_t domain, F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        const auto& members = m_domain_workers.at(domain);
+        size_t index = members[m_next_queue.fetch_add(1, std::memory_order_relaxed) % members.size()];
+        return push(index, Placement::Domain, std::forward<F>(func), std::forward<Args>(args)...);
+    }
+
+    const CpuTopology& topology() const
+    {
+        return m_topology;
+    }
+
+    std::vector<WorkerStats> stats() const
+    {
+        std::vector<WorkerStats> result;
+        for(const auto& queue : m_queues)
+        {
+            result.push_back(WorkerStats{queue->cpu, queue->domain, queue->local.load(),
+                                         queue->stolen_near.load(), queue->stolen_far.load()});
+        }
+        return result;
+    }
+
+private:
+    enum class Placement
+    {
+        Anywhere,
+        Domain
+    };
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;          // anyone may steal these
+        std::deque<std::function<void()>> domain_tasks;   // from enqueue_on, only for this domain
+        int cpu{0};
+        size_t domain{0};
+        std::vector<size_t> steal_order; // same domain first, then the other domains
+        std::atomic<size_t> local{0};
+        std::atomic<size_t> stolen_near{0};
+        std::atomic<size_t> stolen_far{0};
+    };
+
+    CpuTopology m_topology;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::vector<size_t>> m_domain_workers;
+    std::vector<std::thread> m_workers;
+    bool m_pin_workers;
+    std::atomic<size_t> m_next_queue{0};
+    std::atomic<size_t> m_pending{0};                          // tasks anyone can run
+    std::unique_ptr<std::atomic<size_t>[]> m_domain_pending;   // domain tasks, per domain
+    std::atomic<size_t> m_sleepers{0};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    static inline thread_local TopologyThreadPool* t_owner = nullptr;
+    static inline thread_local size_t t_index = 0;
+
+    /// Keeps at most max_cpus CPUs, taking one from each domain in turn, and drops empty domains.
+    static CpuTopology select_cpus(CpuTopology topology, size_t max_cpus)
+    {
+        std::vector<std::vector<int>> kept(topology.domains.size());
+        size_t taken = 0;
+        for(size_t round=0; taken<max_cpus; ++round)
+        {
+            bool any = false;
+            for(size_t d=0; d<topology.domains.size() && taken<max_cpus; ++d)
+            {
+                if(round < topology.domains[d].cpus.size())
+                {
+                    kept[d].push_back(topology.domains[d].cpus[round]);
+                    ++taken;
+                    any = true;
+                }
+            }
+            if(!any)
+            {
+                break;
+            }
+        }
+
+        CpuTopology selected;
+        for(size_t d=0; d<topology.domains.size(); ++d)
+        {
+            if(!kept[d].empty())
+            {
+                selected.domains.push_back(CpuTopology::Domain{topology.domains[d].id, std::move(kept[d])});
+            }
+        }
+        return selected;
+    }
+
+    void build_steal_orders()
+    {
+        const size_t num_domains = m_domain_workers.size();
+        for(size_t i=0; i<m_queues.size(); ++i)
+        {
+            auto& order = m_queues[i]->steal_order;
+            const size_t home = m_queues[i]->domain;
+            // Rotate so that workers of the same domain don't all hit the same victim first.
+            for(size_t d=0; d<num_domains; ++d)
+            {
+                const auto& members = m_domain_workers[(home + d) % num_domains];
+                for(size_t k=0; k<members.size(); ++k)
+                {
+                    size_t victim = members[(i + k) % members.size()];
+                    if(victim != i)
+                    {
+                        order.push_back(victim);
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto push(size_t index, Placement placement, F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        auto& queue = *m_queues[index];
+        {
+            // Same lock as the workers' exit check: a worker that saw m_stop_flag and no work is
+            // gone, so after that nothing may be counted for it anymore. Counting under the lock
+            // also means a worker about to sleep either sees the task or gets the notify below.
+            std::lock_guard lock(m_sleep_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+            (placement == Placement::Domain ? m_domain_pending[queue.domain] : m_pending).fetch_add(1);
+        }
+
+        {
+            std::lock_guard lock(queue.mutex);
+            (placement == Placement::Domain ? queue.domain_tasks : queue.tasks).push_back([task]() { (*task)(); });
+        }
+        if(m_sleepers.load() > 0)
+        {
+            // notify_one could wake a worker of another domain that can't run a domain task.
+            if(placement == Placement::Domain)
+            {
+                m_sleep_cv.notify_all();
+            }
+            else
+            {
+                m_sleep_cv.notify_one();
+            }
+        }
+        return result;
+    }
+
+    /// Takes a task out of `queue`, lock held. Domain tasks only if `domain_ok`.
+    bool take(WorkQueue& queue, bool from_back, bool domain_ok, std::function<void()>& task)
+    {
+        if(!queue.tasks.empty())
+        {
+            task = std::move(from_back ? queue.tasks.back() : queue.tasks.front());
+            from_back ? queue.tasks.pop_back() : queue.tasks.pop_front();
+            m_pending.fetch_sub(1);
+            return true;
+        }
+        if(domain_ok && !queue.domain_tasks.empty())
+        {
+            task = std::move(queue.domain_tasks.front());
+            queue.domain_tasks.pop_front();
+            m_domain_pending[queue.domain].fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    bool pop_local(size_t index, std::function<void()>& task)
+    {
+        auto& queue = *m_queues[index];
+        std::lock_guard lock(queue.mutex);
+        return take(queue, true, true, task);
+    }
+
+    bool steal(size_t thief, std::function<void()>& task)
+    {
+        auto& self = *m_queues[thief];
+        for(size_t victim_index : self.steal_order)
+        {
+            auto& victim = *m_queues[victim_index];
+            std::unique_lock lock(victim.mutex, std::try_to_lock);
+            const bool near = victim.domain == self.domain;
+            if(!lock.owns_lock() || !take(victim, false, near, task))
+            {
+                continue;
+            }
+            ++(near ? self.stolen_near : self.stolen_far);
+            return true;
+        }
+        return false;
+    }
+
+    /// Work this worker could run: anybody's regular tasks or its own domain's tasks.
+    bool has_work(size_t index) const
+    {
+        return m_pending.load() > 0 || m_domain_pending[m_queues[index]->domain].load() > 0;
+    }
+
+    void worker(size_t index)
+    {
+        // Before the first task: pinning from the constructor would race with it.
+        if(m_pin_workers && !pin_to_cpu(m_queues[index]->cpu))
+        {
+            LOG("Could not pin worker ", index, " to cpu ", m_queues[index]->cpu);
+        }
+        t_owner = this;
+        t_index = index;
+        while(true)
+        {
+            std::function<void()> task;
+            if(pop_local(index, task))
+            {
+                m_queues[index]->local.fetch_add(1, std::memory_order_relaxed);
+            }
+            if(task || steal(index, task))
+            {
+                task();
+                continue;
+            }
+            if(has_work(index))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock lock(m_sleep_mutex);
+            m_sleepers.fetch_add(1);
+            m_sleep_cv.wait(lock, [this, index](){
+                return m_stop_flag || has_work(index);
+            });
+            m_sleepers.fetch_sub(1);
+
+            if(m_stop_flag && !has_work(index))
+            {
+                return;
+            }
+        }
+    }
+};
+
+/**
+ * DEMO: each domain gets its own array and tasks that sum slices of it, placed with enqueue_on.
+ * Stats show most tasks ran where they were placed (local) and steals stayed inside the domain.
+ */
+double run_sums(TopologyThreadPool& pool, std::vector<std::vector<double>>& data, size_t slice)
+{
+    size_t num_tasks = 0;
+    for(auto& array : data)
+    {
+        num_tasks += array.size() / slice;
+    }
+    std::latch done{static_cast<std::ptrdiff_t>(num_tasks)};
+    std::atomic<long long> total{0};
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t d=0; d<data.size(); ++d)
+    {
+        for(size_t begin=0; begin + slice <= data[d].size(); begin += slice)
+        {
+            pool.enqueue_on(d, [&, d, begin](){
+                double sum = 0;
+                for(size_t i=begin; i<begin + slice; ++i)
+                {
+                    sum += data[d][i];
+                }
+                total.fetch_add(static_cast<long long>(sum), std::memory_order_relaxed);
+                done.count_down();
+            });
+        }
+    }
+    done.wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+    for(auto grouping : {Grouping::NumaNode, Grouping::L3Cache})
+    {
+        auto topology = CpuTopology::read(grouping);
+        LOG(grouping == Grouping::NumaNode ? "NUMA nodes: " : "L3 domains: ", topology.domains.size());
+        for(const auto& domain : topology.domains)
+        {
+            std::string cpus;
+            for(int cpu : domain.cpus)
+            {
+                cpus += std::to_string(cpu) + " ";
+            }
+            LOG("  domain ", domain.id, ": cpus ", cpus);
+        }
+    }
+
+    constexpr size_t elements_per_domain = 1 << 22;
+    constexpr size_t slice = 1 << 14;
+    for(bool pin : {false, true})
+    {
+        TopologyThreadPool pool(std::thread::hardware_concurrency(), {Grouping::NumaNode, pin});
+        // Touch each array from its own domain so first-touch places the pages on that node. enqueue_on
+        // tasks can't be stolen by another domain, so this really runs there.
+        std::vector<std::vector<double>> data(pool.topology().domains.size());
+        for(size_t d=0; d<data.size(); ++d)
+        {
+            pool.enqueue_on(d, [&data, d](){ data[d].assign(elements_per_domain, 1.0); }).get();
+        }
+
+        double seconds = run_sums(pool, data, slice);
+        LOG(pin ? "pinned:   " : "unpinned: ", seconds * 1000, "ms");
+        for(const auto& s : pool.stats())
+        {
+            LOG("  cpu ", s.cpu, " domain ", s.domain, ": local ", s.local, ", stolen near ", s.stolen_near,
+                ", stolen far ", s.stolen_far);
+        }
+    }
+    return 0;
+}
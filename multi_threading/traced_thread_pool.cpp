@@ -0,0 +1,511 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <array>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <latch>
+#include <memory>
+#include <bit>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * INSTRUMENTED ThreadPool
+ * What we record while tracing is on:
+ *  - per task:   enqueue -> start latency, run time, queue depth when it was picked up.
+ *  - per worker: busy and idle nanoseconds.
+ *  - per worker: the last TRACE_CAPACITY tasks as trace events (start, duration, wait).
+ *
+ * Lock-free per-thread histograms: every worker owns its Telemetry block and is the ONLY writer, so
+ * "count = count + 1" with relaxed load/store is enough, no read-modify-write needed. Readers
+ * (snapshot) just load and merge. Buckets are powers of two: bucket b counts values in
+ * [2^(b-1), 2^b), so percentiles are exact to within a factor of two, which is enough to spot tails.
+ *
+ * Disabled cost: one relaxed load of m_tracing in enqueue and one per task in the worker. No clock
+ * reads, no stores. Compare the three columns printed by main().
+ *
+ * export_chrome_trace() writes the Trace Event format ("ph":"X" complete events, timestamps in us),
+ * which chrome://tracing and https://ui.perfetto.dev open directly. Call it while the pool is idle:
+ * the event rings are plain data written by the workers.
+ */
+
+constexpr size_t CACHE_LINE = 64;
+
+struct HistogramSnapshot
+{
+    static constexpr size_t BUCKETS = 48;
+    std::array<uint64_t, BUCKETS> counts{};
+    uint64_t total{0};
+    uint64_t sum{0};
+    uint64_t max{0};
+
+    double mean() const
+    {
+        return total ? static_cast<double>(sum) / total : 0.0;
+    }
+
+    /// Upper bound of the bucket holding the p-th percentile (p in [0, 1]).
+    uint64_t percentile(double p) const
+    {
+        uint64_t rank = static_cast<uint64_t>(p * total);
+        uint64_t seen = 0;
+        for(size_t b=0; b<BUCKETS; ++b)
+        {
+            seen += counts[b];
+            if(seen > rank)
+            {
+                return std::min<uint64_t>(b == 0 ? 0 : (uint64_t{1} << b) - 1, max);
+            }
+        }
+        return max;
+    }
+
+    void merge(const HistogramSnapshot& other)
+    {
+        for(size_t b=0; b<BUCKETS; ++b)
+        {
+            counts[b] += other.counts[b];
+        }
+        total += other.total;
+        sum += other.sum;
+        max = std::max(max, other.max);
+    }
+};
+
+/// Single writer (the owning worker), any number of readers.
+class Histogram
+{
+public:
+    void record(uint64_t value)
+    {
+        size_t bucket = std::min<size_t>(std::bit_width(value), HistogramSnapshot::BUCKETS - 1);
+        bump(m_counts[bucket], 1);
+        bump(m_total, 1);
+        bump(m_sum, value);
+        if(value > m_max.load(std::memory_order_relaxed))
+        {
+            m_max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    HistogramSnapshot snapshot() const
+    {
+        HistogramSnapshot s;
+        for(size_t b=0; b<HistogramSnapshot::BUCKETS; ++b)
+        {
+            s.counts[b] = m_counts[b].load(std::memory_order_relaxed);
+        }
+        s.total = m_total.load(std::memory_order_relaxed);
+        s.sum = m_sum.load(std::memory_order_relaxed);
+        s.max = m_max.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKETS> m_counts{};
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t by)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+};
+
+struct TraceSnapshot
+{
+    struct Worker
+    {
+        uint64_t busy_ns;
+        uint64_t idle_ns;
+        uint64_t tasks;
+
+        double busy_ratio() const
+        {
+            uint64_t total = busy_ns + idle_ns;
+            return total ? static_cast<double>(busy_ns) / total : 0.0;
+        }
+    };
+
+    HistogramSnapshot wait_ns;
+    HistogramSnapshot run_ns;
+    HistogramSnapshot queue_depth;
+    std::vector<Worker> workers;
+};
+
+class TracedThreadPool
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t TRACE_CAPACITY = 1 << 14;
+
+    TracedThreadPool(size_t num_threads = std::thread::hardware_concurrency(), bool tracing = false):
+        m_tracing(tracing),
+        m_epoch(Clock::now())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_telemetry.push_back(std::make_unique<Telemetry>());
+        }
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this, i]{ worker(i);}
+            });
+        }
+    }
+
+    ~TracedThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    void set_tracing(bool enabled)
+    {
+        m_tracing.store(enabled, std::memory_order_relaxed);
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        // 0 means "not traced"; the clock is only read when tracing is on.
+        uint64_t enqueue_ns = m_tracing.load(std::memory_order_relaxed) ? now_ns() : 0;
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push(Task{[task]() { (*task)(); }, enqueue_ns});
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+    TraceSnapshot snapshot() const
+    {
+        TraceSnapshot s;
+        for(const auto& t : m_telemetry)
+        {
+            s.wait_ns.merge(t->wait_ns.snapshot());
+            s.run_ns.merge(t->run_ns.snapshot());
+            s.queue_depth.merge(t->queue_depth.snapshot());
+            s.workers.push_back(TraceSnapshot::Worker{
+                t->busy_ns.load(std::memory_order_relaxed),
+                t->idle_ns.load(std::memory_order_relaxed),
+                t->run_ns.snapshot().total});
+        }
+        return s;
+    }
+
+    /// Chrome trace-event JSON. Call while the pool is idle.
+    void export_chrome_trace(const std::string& path) const
+    {
+        std::ofstream out(path);
+        // Fixed notation: long runs would otherwise print timestamps as 1.23457e+06.
+        out << std::fixed << std::setprecision(3);
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for(size_t w=0; w<m_telemetry.size(); ++w)
+        {
+            const auto& t = *m_telemetry[w];
+            out << (first ? "" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << w
+                << ",\"args\":{\"name\":\"worker " << w << "\"}}";
+            first = false;
+
+            uint64_t written = t.events_written.load(std::memory_order_acquire);
+            uint64_t begin = written > TRACE_CAPACITY ? written - TRACE_CAPACITY : 0;
+            for(uint64_t i=begin; i<written; ++i)
+            {
+                const auto& e = t.events[i % TRACE_CAPACITY];
+                out << ",\n{\"name\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":" << w
+                    << ",\"ts\":" << e.start_ns / 1000.0 << ",\"dur\":" << e.run_ns / 1000.0
+                    << ",\"args\":{\"wait_us\":" << e.wait_ns / 1000.0 << ",\"queue_depth\":" << e.queue_depth << "}}";
+            }
+        }
+        out << "\n]}\n";
+    }
+
+private:
+    struct Task
+    {
+        std::function<void()> run;
+        uint64_t enqueue_ns;
+    };
+
+    struct TraceEvent
+    {
+        uint64_t start_ns;
+        uint64_t run_ns;
+        uint64_t wait_ns;
+        uint64_t queue_depth;
+    };
+
+    /// One per worker, on its own cache lines so workers never false-share counters.
+    struct alignas(CACHE_LINE) Telemetry
+    {
+        Histogram wait_ns;
+        Histogram run_ns;
+        Histogram queue_depth;
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> idle_ns{0};
+        std::atomic<uint64_t> events_written{0};
+        std::vector<TraceEvent> events = std::vector<TraceEvent>(TRACE_CAPACITY);
+    };
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<Telemetry>> m_telemetry;
+    std::queue<Task> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+    std::atomic<bool> m_tracing;
+    Clock::time_point m_epoch;
+
+    uint64_t now_ns() const
+    {
+        // +1 keeps 0 free as the "not traced" marker.
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count()) + 1;
+    }
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t by)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    void worker(size_t index)
+    {
+        Telemetry& t = *m_telemetry[index];
+        while(true)
+        {
+            Task task;
+            uint64_t depth = 0;
+            bool tracing = m_tracing.load(std::memory_order_relaxed);
+            uint64_t idle_start = tracing ? now_ns() : 0;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                depth = m_task_queue.size();
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+
+            if(!tracing || task.enqueue_ns == 0) [[likely]]
+            {
+                task.run();
+                continue;
+            }
+
+            uint64_t start = now_ns();
+            task.run();
+            uint64_t end = now_ns();
+
+            uint64_t wait = start > task.enqueue_ns ? start - task.enqueue_ns : 0;
+            t.wait_ns.record(wait);
+            t.run_ns.record(end - start);
+            t.queue_depth.record(depth);
+            add(t.idle_ns, start - idle_start);
+            add(t.busy_ns, end - start);
+
+            uint64_t slot = t.events_written.load(std::memory_order_relaxed);
+            t.events[slot % TRACE_CAPACITY] = TraceEvent{start, end - start, wait, depth};
+            t.events_written.store(slot + 1, std::memory_order_release);
+        }
+    }
+};
+
+/// The original ThreadPool, without any instrumentation, as the overhead baseline.
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push([task]() { (*task)(); });
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+template <typename Pool>
+double tasks_per_second(Pool& pool, size_t num_tasks)
+{
+    std::latch done{static_cast<std::ptrdiff_t>(num_tasks)};
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i=0; i<num_tasks; ++i)
+    {
+        pool.enqueue([&done](){ done.count_down(); });
+    }
+    done.wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return num_tasks / elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t num_threads = 4;
+    constexpr size_t num_tasks = 200000;
+    // Only written when asked for, e.g. ./traced_thread_pool /tmp/thread_pool_trace.json
+    std::string trace_path = argc > 1 ? argv[1] : "";
+
+    double baseline = 0, disabled = 0, enabled = 0;
+    {
+        ThreadPool pool(num_threads);
+        baseline = tasks_per_second(pool, num_tasks);
+    }
+    {
+        TracedThreadPool pool(num_threads, false);
+        disabled = tasks_per_second(pool, num_tasks);
+    }
+    TracedThreadPool pool(num_threads, true);
+    enabled = tasks_per_second(pool, num_tasks);
+    LOG("tasks/s: no instrumentation ", static_cast<size_t>(baseline), ", tracing off ",
+        static_cast<size_t>(disabled), ", tracing on ", static_cast<size_t>(enabled));
+
+    // A second, uneven workload so the trace has something to look at.
+    std::vector<std::future<void>> results;
+    for(int i=0; i<200; ++i)
+    {
+        results.push_back(pool.enqueue([i](){ std::this_thread::sleep_for(std::chrono::microseconds(100 * (i % 7))); }));
+    }
+    for(auto& result: results)
+    {
+        result.get();
+    }
+
+    auto s = pool.snapshot();
+    LOG("tasks ", s.run_ns.total, ", wait ns p50 ", s.wait_ns.percentile(0.5), " p99 ", s.wait_ns.percentile(0.99),
+        " max ", s.wait_ns.max, ", run ns p50 ", s.run_ns.percentile(0.5), " p99 ", s.run_ns.percentile(0.99),
+        ", queue depth mean ", s.queue_depth.mean());
+    for(size_t w=0; w<s.workers.size(); ++w)
+    {
+        LOG("  worker ", w, ": tasks ", s.workers[w].tasks, ", busy ", s.workers[w].busy_ratio() * 100, "%");
+    }
+
+    if(trace_path.empty())
+    {
+        LOG("Pass a file path to export a Chrome trace (chrome://tracing or ui.perfetto.dev)");
+    }
+    else
+    {
+        pool.export_chrome_trace(trace_path);
+        LOG("Trace written to ", trace_path, " (open in chrome://tracing or ui.perfetto.dev)");
+    }
+    return 0;
+}
@@ -0,0 +1,363 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <latch>
+#include <memory>
+
+template <typename... Args>
+void LOG(Args... args)
+{
+    (std::cout << ... << args) << std::endl;
+}
+
+/**
+ * WORK STEALING
+ * The ThreadPool in thread_pool.cpp keeps ONE queue behind ONE mutex. With short tasks every worker
+ * spends most of its time fighting for that mutex instead of running tasks.
+ *
+ * Work stealing splits the queue:
+ *  1. Every worker owns a deque. The owner pushes and pops at the BACK (LIFO, cache is still warm).
+ *  2. An idle worker steals from the FRONT of another worker's deque (oldest task, usually the biggest).
+ *  3. Tasks enqueued from outside the pool are spread round-robin over the deques. Tasks enqueued
+ *     from inside a worker go straight into that worker's own deque.
+ *
+ * Each deque still has a mutex, but now the lock is only shared between the owner and the occasional
+ * thief, so contention drops from "all workers" to "almost nobody".
+ *
+ * Sleeping: workers that find nothing anywhere park on a condition variable. A pending-task counter
+ * and a sleeper counter let enqueue() skip the notify (and its mutex) when nobody is asleep.
+ */
+
+/// The original global-queue design from thread_pool.cpp, kept here for the benchmark.
+class ThreadPool
+{
+public:
+    ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this]{ worker();}
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+
+        m_queue_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::unique_lock lock(m_queue_mutex);
+            if(m_stop_flag)
+            {
+                throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+            }
+
+            m_task_queue.push([task]() { (*task)(); });
+        }
+        m_queue_cv.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_task_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    void worker()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_queue_mutex);
+                m_queue_cv.wait(lock, [this](){
+                    return m_stop_flag || !m_task_queue.empty();
+                });
+
+                if(m_stop_flag && m_task_queue.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_task_queue.front());
+                m_task_queue.pop();
+            }
+            task();
+        }
+    }
+};
+
+class WorkStealingThreadPool
+{
+public:
+    WorkStealingThreadPool(size_t num_threads = std::thread::hardware_concurrency())
+    {
+        if(num_threads == 0)
+        {
+            num_threads = 1;
+        }
+        /// NOTE: WorkQueue holds a mutex, so it is neither copyable nor movable. Build all of them
+        /// before starting any thread so the vector never reallocates under a running worker.
+        m_queues.reserve(num_threads);
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_queues.push_back(std::make_unique<WorkQueue>());
+        }
+        for(size_t i=0; i<num_threads; ++i)
+        {
+            m_workers.push_back(std::thread{
+                [this, i]{ worker(i);}
+            });
+        }
+    }
+
+    ~WorkStealingThreadPool()
+    {
+        {
+            std::lock_guard lock(m_sleep_mutex);
+            m_stop_flag = true;
+        }
+
+        m_sleep_cv.notify_all();
+
+        for(auto& thread: m_workers)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    /// Same signature as ThreadPool::enqueue so the two pools are drop-in replacements.
+    template <typename F, typename... Args>
+    auto enqueue(F&& func, Args... args) -> std::future<decltype(func(args...))>
+    {
+        using ReturnType = decltype(func(args...));
+
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+                std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+
+        std::future<ReturnType> result = task->get_future();
+        if(m_stop_flag)
+        {
+            throw std::runtime_error("Cannot enqueue on stopped Threadpool");
+        }
+
+        /// NOTE: pending++ and the sleepers check must be seq_cst. Together with the worker doing
+        /// sleepers++ and then checking pending, one of the two sides is guaranteed to see the other,
+        /// so a task can never be left behind while everyone sleeps. Counting before the push also
+        /// keeps a fast thief from decrementing below zero.
+        m_pending.fetch_add(1);
+
+        // Inside one of our own workers: keep the task local. Outside: round-robin.
+        size_t index = (t_owner == this)
+            ? t_index
+            : m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        {
+            std::lock_guard lock(m_queues[index]->mutex);
+            m_queues[index]->tasks.push_back([task]() { (*task)(); });
+        }
+
+        if(m_sleepers.load() > 0)
+        {
+            // Taking the mutex makes sure the sleeper is really inside wait() before we notify.
+            { std::lock_guard lock(m_sleep_mutex); }
+            m_sleep_cv.notify_one();
+        }
+        return result;
+    }
+
+    size_t size() const
+    {
+        return m_workers.size();
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_next_queue{0};
+    std::atomic<size_t> m_pending{0};
+    std::atomic<size_t> m_sleepers{0};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep_cv;
+    std::atomic<bool> m_stop_flag{false};
+
+    /// Lets enqueue() know whether it is being called from one of this pool's workers.
+    static inline thread_local WorkStealingThreadPool* t_owner = nullptr;
+    static inline thread_local size_t t_index = 0;
+
+    bool pop_local(size_t index, std::function<void()>& task)
+    {
+        auto& queue = *m_queues[index];
+        std::lock_guard lock(queue.mutex);
+        if(queue.tasks.empty())
+        {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t thief, std::function<void()>& task)
+    {
+        const size_t n = m_queues.size();
+        for(size_t offset=1; offset<n; ++offset)
+        {
+            auto& victim = *m_queues[(thief + offset) % n];
+            // try_lock: if the victim is busy with its own deque, move on instead of queueing up.
+            std::unique_lock lock(victim.mutex, std::try_to_lock);
+            if(!lock.owns_lock() || victim.tasks.empty())
+            {
+                continue;
+            }
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void worker(size_t index)
+    {
+        t_owner = this;
+        t_index = index;
+        while(true)
+        {
+            std::function<void()> task;
+            if(pop_local(index, task) || steal(index, task))
+            {
+                m_pending.fetch_sub(1);
+                task();
+                continue;
+            }
+            if(m_pending.load() > 0)
+            {
+                // Something is queued but we lost the try_lock race (or the push is still in flight).
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock lock(m_sleep_mutex);
+            m_sleepers.fetch_add(1);
+            m_sleep_cv.wait(lock, [this](){
+                return m_stop_flag || m_pending.load() > 0;
+            });
+            m_sleepers.fetch_sub(1);
+
+            if(m_stop_flag && m_pending.load() == 0)
+            {
+                return;
+            }
+        }
+    }
+};
+
+/**
+ * BENCHMARK
+ *  external: main thread enqueues every task (all submissions come from outside the pool).
+ *  nested:   a few root tasks each enqueue many children from inside the pool, which is where
+ *            local deques and stealing pay off the most.
+ * Tasks are tiny on purpose so we measure scheduling overhead, not work.
+ */
+template <typename Pool>
+double external_tasks_per_second(size_t num_threads, size_t num_tasks)
+{
+    Pool pool(num_threads);
+    std::latch done{static_cast<std::ptrdiff_t>(num_tasks)};
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i=0; i<num_tasks; ++i)
+    {
+        pool.enqueue([&done](){ done.count_down(); });
+    }
+    done.wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return num_tasks / elapsed.count();
+}
+
+template <typename Pool>
+double nested_tasks_per_second(size_t num_threads, size_t num_roots, size_t children_per_root)
+{
+    Pool pool(num_threads);
+    const size_t num_tasks = num_roots * (children_per_root + 1);
+    std::latch done{static_cast<std::ptrdiff_t>(num_tasks)};
+    auto start = std::chrono::steady_clock::now();
+    for(size_t r=0; r<num_roots; ++r)
+    {
+        pool.enqueue([&pool, &done, children_per_root](){
+            for(size_t c=0; c<children_per_root; ++c)
+            {
+                pool.enqueue([&done](){ done.count_down(); });
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return num_tasks / elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+    constexpr size_t num_tasks = 200000;
+    constexpr size_t num_roots = 64;
+    constexpr size_t children_per_root = num_tasks / num_roots;
+
+    LOG("HW threads: ", std::thread::hardware_concurrency(), ", tasks per run: ", num_tasks);
+    LOG("threads | global external | stealing external | global nested | stealing nested  (tasks/s)");
+    for(size_t threads : {1, 4, 16, 64})
+    {
+        LOG(threads, " | ",
+            static_cast<size_t>(external_tasks_per_second<ThreadPool>(threads, num_tasks)), " | ",
+            static_cast<size_t>(external_tasks_per_second<WorkStealingThreadPool>(threads, num_tasks)), " | ",
+            static_cast<size_t>(nested_tasks_per_second<ThreadPool>(threads, num_roots, children_per_root)), " | ",
+            static_cast<size_t>(nested_tasks_per_second<WorkStealingThreadPool>(threads, num_roots, children_per_root)));
+    }
+
+    // enqueue() is the same API as ThreadPool, return values included.
+    WorkStealingThreadPool pool(4);
+    auto answer = pool.enqueue([](int a, int b){ return a * b; }, 6, 7);
+    LOG("6 * 7 = ", answer.get());
+    return 0;
+}